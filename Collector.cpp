@@ -1,21 +1,23 @@
 #include <iostream>
 #include <libudev.h>
-#include <sys/socket.h>
-#include <linux/netlink.h>
 #include <cstring>
-#include <unistd.h>
-#include <sys/epoll.h>
-#include <functional>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-#define UEVENT_BUFFER_SIZE 2048
+#include "common/udev_handle.h"
+#include "common/udev_monitor.h"
 
 struct USBDeviceInfo {
     std::string vendor_id;
     std::string product_id;
     std::string manufacturer;
     std::string product;
+    std::string driver;
+
+    USBDeviceInfo() {}
 
     USBDeviceInfo(const std::string& vendor, const std::string& product, const std::string& manuf, const std::string& prod) 
         : vendor_id(vendor), product_id(product), manufacturer(manuf), product(prod) {}
@@ -28,165 +30,223 @@ struct USBDeviceInfo {
         std::cout << "Product: " << product << std::endl;
         std::cout << "-----------------------" << std::endl;
     }
+
+    bool is_complete() const {
+        return !vendor_id.empty() && !product_id.empty() && !manufacturer.empty() && !product.empty();
+    }
 };
 
 
-using EventCallback = std::function<void(const std::map<std::string, std::string>&)>;
+// In-memory view of the USB subsystem keyed by DEVPATH. It is seeded once from
+// udev and then kept current by uevents, so the event path never rescans sysfs.
+class USBDeviceTable {
+public:
+    void seed();
+    void apply_event(const UeventView& event);
 
-std::map<std::string, std::string> parse_event_data(const char* buffer, ssize_t length) {
-    std::map<std::string, std::string> event_data;
+    const USBDeviceInfo* find(std::string_view devpath) const;
+    std::vector<std::pair<std::string, USBDeviceInfo>> snapshot() const;
+    size_t size() const { return devices_.size(); }
+    void print() const;
 
-    for (const char* ptr = buffer; ptr < buffer + length; ptr += strlen(ptr) + 1) {
-        std::string entry(ptr);
-        size_t equal_pos = entry.find('=');
+private:
+    void fill_from_udev(const std::string& devpath, USBDeviceInfo& info);
+    const std::string& lookup_key(std::string_view devpath) const;
 
-        if (equal_pos != std::string::npos) {
-            std::string key = entry.substr(0, equal_pos);
-            std::string value = entry.substr(equal_pos + 1);
-            event_data[key] = value;
-        }
-    }
+    std::unordered_map<std::string, USBDeviceInfo> devices_;
+    // Reused for lookups so the event path does not allocate a key per event.
+    mutable std::string lookup_key_;
+};
 
-    return event_data;
+static void assign_if_set(std::string& field, const char* value) {
+    if (value && *value) {
+        field = value;
+    }
 }
 
-
-void handle_device_event(int sock_fd, EventCallback callback) {
-    char buffer[UEVENT_BUFFER_SIZE];
-    ssize_t length = recv(sock_fd, buffer, sizeof(buffer), 0);
-    if (length < 0) {
-        std::cerr << "Failed to receive message" << std::endl;
-        return;
+static void assign_from_event(std::string& field, const UeventView& event, UeventKey key) {
+    std::string_view value = event.get(key);
+    if (!value.empty()) {
+        field.assign(value.data(), value.size());
     }
-    std::map<std::string, std::string> event_data = parse_event_data(buffer, length);
-    callback(event_data);
 }
 
-
-void monitor_device_events(EventCallback callback) {
-    // Step 1: Create a netlink socket
-    int sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_KOBJECT_UEVENT);
-    if (sock < 0) {
-        std::cerr << "Failed to create socket" << std::endl;
+void USBDeviceTable::seed() {
+    // We are interested only in USB devices
+    UdevEnumeratePtr enumerate = scan_subsystem("usb", "DEVTYPE", "usb_device");
+    if (!enumerate) {
         return;
     }
 
+    struct udev_list_entry* entry;
 
-    struct sockaddr_nl addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.nl_family = AF_NETLINK;
-    addr.nl_pid = getpid();
-    addr.nl_groups = 1; // Listen to the kernel event group
+    devices_.clear();
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate.get())) {
+        const char* path = udev_list_entry_get_name(entry);
+        UdevDevicePtr device(udev_device_new_from_syspath(udev_context(), path));
+        if (!device) {
+            continue;
+        }
 
-    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        std::cerr << "Failed to bind socket" << std::endl;
-        close(sock);
-        return;
+        const char* devpath = udev_device_get_devpath(device.get());
+        if (devpath) {
+            USBDeviceInfo& info = devices_[devpath];
+            assign_if_set(info.vendor_id, udev_device_get_property_value(device.get(), "ID_VENDOR_ID"));
+            assign_if_set(info.product_id, udev_device_get_property_value(device.get(), "ID_MODEL_ID"));
+            assign_if_set(info.manufacturer, udev_device_get_property_value(device.get(), "ID_VENDOR"));
+            assign_if_set(info.product, udev_device_get_property_value(device.get(), "ID_MODEL"));
+            assign_if_set(info.driver, udev_device_get_driver(device.get()));
+        }
     }
+}
 
-
-    int epoll_fd = epoll_create1(0);
-    if (epoll_fd < 0) {
-        std::cerr << "Failed to create epoll instance" << std::endl;
-        close(sock);
+// Kernel uevents carry no ID_* properties, so a device that shows up without
+// them is completed from its own sysfs entry. This touches one device only,
+// never the whole subsystem.
+void USBDeviceTable::fill_from_udev(const std::string& devpath, USBDeviceInfo& info) {
+    std::string syspath = "/sys" + devpath;
+    UdevDevicePtr handle(udev_device_new_from_syspath(udev_context(), syspath.c_str()));
+    if (!handle) {
         return;
     }
+    struct udev_device* device = handle.get();
 
-    struct epoll_event event;
-    event.events = EPOLLIN;  
-    event.data.fd = sock; 
+    // Prefer udev's database, fall back to the raw descriptor strings.
+    auto complete = [device](std::string& field, const char* property, const char* sysattr) {
+        if (field.empty()) {
+            assign_if_set(field, udev_device_get_property_value(device, property));
+        }
+        if (field.empty()) {
+            assign_if_set(field, udev_device_get_sysattr_value(device, sysattr));
+        }
+    };
+    complete(info.vendor_id, "ID_VENDOR_ID", "idVendor");
+    complete(info.product_id, "ID_MODEL_ID", "idProduct");
+    complete(info.manufacturer, "ID_VENDOR", "manufacturer");
+    complete(info.product, "ID_MODEL", "product");
+}
 
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) < 0) {
-        std::cerr << "Failed to add socket to epoll" << std::endl;
-        close(sock);
-        close(epoll_fd);
+void USBDeviceTable::apply_event(const UeventView& event) {
+    std::string_view action = event.get(UeventKey::Action);
+    std::string_view devpath_view = event.get(UeventKey::Devpath);
+    if (action.empty() || devpath_view.empty()) {
         return;
     }
 
-    struct epoll_event events[10];
-    while (true) {
-        int num_events = epoll_wait(epoll_fd, events, 10, -1); 
-        if (num_events < 0) {
-            std::cerr << "Error in epoll_wait" << std::endl;
-            break;
-        }
+    const std::string& devpath = lookup_key(devpath_view);
+    if (action == "remove") {
+        devices_.erase(devpath);
+        return;
+    }
 
-        // Handle each event
-        for (int i = 0; i < num_events; i++) {
-            if (events[i].data.fd == sock) {
-                handle_device_event(sock, callback);
-            }
+    if (action == "move") {
+        auto it = devices_.find(lookup_key(event.get(UeventKey::DevpathOld)));
+        if (it != devices_.end()) {
+            USBDeviceInfo info = std::move(it->second);
+            devices_.erase(it);
+            devices_[std::string(devpath_view)] = std::move(info);
         }
+        return;
     }
 
-    close(sock);
-    close(epoll_fd);
-}
-
-void list_existing_usb_devices() {
-    struct udev* udev = udev_new();
-    if (!udev) {
-        std::cerr << "Cannot create udev context" << std::endl;
+    USBDeviceInfo& info = devices_[devpath];
+    if (action == "unbind") {
+        info.driver.clear();
         return;
     }
 
-    struct udev_enumerate* enumerate = udev_enumerate_new(udev);
-    udev_enumerate_add_match_subsystem(enumerate, "usb");  // We are interested only in USB devices
-    udev_enumerate_scan_devices(enumerate);
+    assign_from_event(info.vendor_id, event, UeventKey::IdVendorId);
+    assign_from_event(info.product_id, event, UeventKey::IdModelId);
+    assign_from_event(info.manufacturer, event, UeventKey::IdVendor);
+    assign_from_event(info.product, event, UeventKey::IdModel);
+    assign_from_event(info.driver, event, UeventKey::Driver);
 
-    struct udev_list_entry* devices = udev_enumerate_get_list_entry(enumerate);
-    struct udev_list_entry* entry;
+    if (action == "add" && !info.is_complete()) {
+        fill_from_udev(devpath, info);
+    }
+}
 
-    udev_list_entry_foreach(entry, devices) {
-        const char* path = udev_list_entry_get_name(entry);
-        struct udev_device* device = udev_device_new_from_syspath(udev, path);
+const std::string& USBDeviceTable::lookup_key(std::string_view devpath) const {
+    lookup_key_.assign(devpath.data(), devpath.size());
+    return lookup_key_;
+}
+
+const USBDeviceInfo* USBDeviceTable::find(std::string_view devpath) const {
+    auto it = devices_.find(lookup_key(devpath));
+    return it != devices_.end() ? &it->second : nullptr;
+}
 
-        const char* vendor = udev_device_get_property_value(device, "ID_VENDOR_ID");
-        const char* product = udev_device_get_property_value(device, "ID_MODEL_ID");
-        const char* manufacturer = udev_device_get_property_value(device, "ID_VENDOR");
-        const char* product_name = udev_device_get_property_value(device, "ID_MODEL");
+std::vector<std::pair<std::string, USBDeviceInfo>> USBDeviceTable::snapshot() const {
+    return std::vector<std::pair<std::string, USBDeviceInfo>>(devices_.begin(), devices_.end());
+}
 
-        if (vendor && product && manufacturer && product_name) {
-            USBDeviceInfo device_info(vendor, product, manufacturer, product_name);
-            device_info.print_info();
+void USBDeviceTable::print() const {
+    for (const auto& entry : devices_) {
+        if (entry.second.is_complete()) {
+            entry.second.print_info();
         }
+    }
+}
 
-        udev_device_unref(device);
+int main(int argc, char* argv[]) {
+    bool kernel_mode = argc > 1 && std::strcmp(argv[1], "--kernel") == 0;
+    if (argc > 2 || (argc == 2 && !kernel_mode)) {
+        std::cerr << "Usage: " << argv[0] << " [--kernel]" << std::endl;
+        return 1;
     }
 
-    udev_enumerate_unref(enumerate);
-    udev_unref(udev);
-}
+    // One context for the whole run, shared by the table and the monitor.
+    struct udev* udev = udev_context();
+    if (!udev) {
+        return 1;
+    }
 
-int main() {
+    USBDeviceTable table;
 
     std::cout << "Listing existing USB devices..." << std::endl;
-    list_existing_usb_devices();
-
-    EventCallback callback = [](const std::map<std::string, std::string>& event_data) {
-        auto subsystem = event_data.find("SUBSYSTEM");
-        if (subsystem != event_data.end() && subsystem->second == "usb") {
-            auto action = event_data.find("ACTION");
-            auto vendor_id = event_data.find("ID_VENDOR_ID");
-            auto product_id = event_data.find("ID_MODEL_ID");
-            auto manufacturer = event_data.find("ID_VENDOR");
-            auto product = event_data.find("ID_MODEL");
-
-            if (action != event_data.end()) {
-                std::cout << "USB Device Event: " << action->second << std::endl;
+    table.seed();
+    table.print();
+
+    UeventBatchCallback callback = [&table](const UeventView* events, size_t count) {
+        size_t usb_events = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const UeventView& event = events[i];
+            if (event.get(UeventKey::Subsystem) != "usb" || event.get(UeventKey::Devtype) != "usb_device") {
+                continue;
+            }
+            ++usb_events;
+
+            std::string_view action = event.get(UeventKey::Action);
+            if (!action.empty()) {
+                std::cout << "USB Device Event: " << action << std::endl;
             }
 
-            if (vendor_id != event_data.end() && product_id != event_data.end() &&
-                manufacturer != event_data.end() && product != event_data.end()) {
-                USBDeviceInfo device_info(vendor_id->second, product_id->second, manufacturer->second, product->second);
-                device_info.print_info();
+            table.apply_event(event);
+
+            const USBDeviceInfo* device_info = table.find(event.get(UeventKey::Devpath));
+            if (device_info && device_info->is_complete()) {
+                device_info->print_info();
             }
-            list_existing_usb_devices();
         }
+        if (usb_events > 0) {
+            std::cout << "Tracked USB devices: " << table.size() << std::endl;
+        }
+    };
+
+    UeventMonitorOptions options;
+    options.filter.subsystems = {"usb"};
+    options.overflow_callback = [&table]() {
+        std::cout << "Resynchronising USB device table after dropped events" << std::endl;
+        table.seed();
     };
 
-    monitor_device_events(callback);
+    if (kernel_mode) {
+        // Raw kernel events: filtered in the kernel, ID_* completed from sysfs.
+        monitor_device_events(callback, options);
+    } else {
+        // udevd events arrive pre-filtered and already carry ID_* properties.
+        monitor_udev_events(udev, {{"usb", "usb_device"}}, callback, options);
+    }
 
     return 0;
 }
-
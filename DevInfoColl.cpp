@@ -1,66 +1,124 @@
 #include <libudev.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <cstring>
-#include <map>
-
-std::string get_usb_class_description(const std::string& class_code) {
-    static const std::map<std::string, std::string> usb_class_map = {
-        {"00", "Device: Use class information in the Interface Descriptors"},
-        {"01", "Interface: Audio"},
-        {"02", "Both: Communications and CDC Control"},
-        {"03", "Interface: HID (Human Interface Device)"},
-        {"05", "Interface: Physical"},
-        {"06", "Interface: Image"},
-        {"07", "Interface: Printer"},
-        {"08", "Interface: Mass Storage"},
-        {"09", "Device: Hub"},
-        {"0A", "Interface: CDC-Data"},
-        {"0B", "Interface: Smart Card"},
-        {"0D", "Interface: Content Security"},
-        {"0E", "Interface: Video"},
-        {"0F", "Interface: Personal Healthcare"},
-        {"10", "Interface: Audio/Video Devices"},
-        {"11", "Device: Billboard Device Class"},
-        {"12", "Interface: USB Type-C Bridge Class"},
-        {"13", "Interface: USB Bulk Display Protocol Device Class"},
-        {"14", "Interface: MCTP over USB Protocol Endpoint Device Class"},
-        {"3C", "Interface: I3C Device Class"},
-        {"DC", "Both: Diagnostic Device"},
-        {"E0", "Interface: Wireless Controller"},
-        {"EF", "Both: Miscellaneous"},
-        {"FE", "Interface: Application Specific"},
-        {"FF", "Both: Vendor Specific"}
-    };
-    auto it = usb_class_map.find(class_code);
-    if (it != usb_class_map.end()) {
-        return it->second;
-    } else {
-        return "Unknown USB class";
+#include <unordered_map>
+#include <vector>
+
+#include "common/udev_handle.h"
+#include "common/udev_monitor.h"
+#include "common/usb_class.h"
+
+#define DEFAULT_SOCKET_PATH "/run/devinfocoll.sock"
+#define QUERY_BUFFER_SIZE 65536
+
+static std::string normalize_id(const std::string& id) {
+    std::string normalized;
+    for (char c : id) {
+        normalized += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
     }
+    return normalized;
 }
-void find_dev_node_by_usb(const std::string& vendor_id, const std::string& product_id) {
-    struct udev* udev = udev_new();
-    if (!udev) {
-        std::cerr << "Cannot create udev context" << std::endl;
+
+static std::string usb_id_key(const std::string& vendor_id, const std::string& product_id) {
+    return normalize_id(vendor_id) + ":" + normalize_id(product_id);
+}
+
+// CDC devices either declare class 02 on the device, or declare 00/EF and put
+// a CDC control interface behind an interface association.
+static bool is_cdc_device(std::string_view device_class, std::string_view interfaces) {
+    bool cdc = parse_usb_hex_byte(device_class) == 0x02;
+    for_each_usb_interface(interfaces, [&cdc](const UsbInterfaceClass& iface) {
+        cdc = cdc || iface.interface_class == 0x02;
+    });
+    return cdc;
+}
+
+static void print_usb_interfaces(std::ostream& out, std::string_view interfaces) {
+    for_each_usb_interface(interfaces, [&out](const UsbInterfaceClass& iface) {
+        char codes[9];
+        std::snprintf(codes, sizeof(codes), "%02X/%02X/%02X", iface.interface_class, iface.subclass, iface.protocol);
+        out << "USB Interface (" << codes << "): "
+            << usb_interface_description(iface.interface_class, iface.subclass, iface.protocol) << std::endl;
+    });
+}
+
+struct TtyNode {
+    std::string syspath;
+    std::string devnode;
+};
+
+// USB device syspath -> tty nodes below it, built from a single tty
+// enumeration and shared by every lookup made with it.
+class TtyParentMap {
+public:
+    void build();
+    const std::vector<TtyNode>* find(const std::string& usb_syspath) const {
+        auto it = ttys_.find(usb_syspath);
+        return it != ttys_.end() ? &it->second : nullptr;
+    }
+
+private:
+    std::unordered_map<std::string, std::vector<TtyNode>> ttys_;
+};
+
+void TtyParentMap::build() {
+    ttys_.clear();
+
+    UdevEnumeratePtr tty_enum = scan_subsystem("tty");
+    if (!tty_enum) {
         return;
     }
 
-    struct udev_enumerate* enumerate = udev_enumerate_new(udev);
-    udev_enumerate_add_match_subsystem(enumerate, "usb"); 
-    udev_enumerate_scan_devices(enumerate);
+    struct udev_list_entry* tty_entry;
+    udev_list_entry_foreach(tty_entry, udev_enumerate_get_list_entry(tty_enum.get())) {
+        const char* tty_path = udev_list_entry_get_name(tty_entry);
+        UdevDevicePtr tty_device(udev_device_new_from_syspath(udev_context(), tty_path));
+        if (!tty_device) {
+            continue;
+        }
+        // The parent is owned by tty_device and must not be unreferenced.
+        struct udev_device* usb_device = udev_device_get_parent_with_subsystem_devtype(tty_device.get(), "usb", "usb_device");
+        const char* usb_path = usb_device ? udev_device_get_syspath(usb_device) : nullptr;
+        const char* tty_node = udev_device_get_devnode(tty_device.get());
+        if (usb_path && tty_node) {
+            ttys_[usb_path].push_back(TtyNode{tty_path, tty_node});
+        }
+    }
+}
 
-    struct udev_list_entry* devices = udev_enumerate_get_list_entry(enumerate);
+void find_dev_node_by_usb(const std::string& vendor_id, const std::string& product_id) {
+    UdevEnumeratePtr enumerate = scan_subsystem("usb", "DEVTYPE", "usb_device");
+    if (!enumerate) {
+        return;
+    }
+
+    struct udev_list_entry* devices = udev_enumerate_get_list_entry(enumerate.get());
     struct udev_list_entry* entry;
 
+    TtyParentMap tty_map;
+    bool tty_map_built = false;
+
     udev_list_entry_foreach(entry, devices) {
         const char* path = udev_list_entry_get_name(entry);
-        struct udev_device* device = udev_device_new_from_syspath(udev, path);
+        UdevDevicePtr handle(udev_device_new_from_syspath(udev_context(), path));
+        if (!handle) {
+            continue;
+        }
+        struct udev_device* device = handle.get();
         const char* dev_vendor = udev_device_get_sysattr_value(device, "idVendor");
         const char* dev_product = udev_device_get_sysattr_value(device, "idProduct");
         const char* dev_class = udev_device_get_sysattr_value(device, "bDeviceClass");
 
-        if (dev_vendor && dev_product && vendor_id == dev_vendor && product_id == dev_product) {
+        if (dev_vendor && dev_product && normalize_id(vendor_id) == dev_vendor && normalize_id(product_id) == dev_product) {
             std::cout << "Found matching USB device!" << std::endl;
             const char* dev_node = udev_device_get_devnode(device);
             if (dev_node) {
@@ -69,45 +127,480 @@ void find_dev_node_by_usb(const std::string& vendor_id, const std::string& produ
                 std::cout << "No /dev node associated with this device." << std::endl;
             }
             if (dev_class) {
-                std::string class_description = get_usb_class_description(dev_class);
+                const char* class_description = get_usb_class_description(dev_class);
                 std::cout << "USB Device Class (" << dev_class << "): " << class_description << std::endl;
-                if (std::strcmp(dev_class, "02") == 0) {
-                    struct udev_enumerate* tty_enum = udev_enumerate_new(udev);
-                    udev_enumerate_add_match_subsystem(tty_enum, "tty");
-                    udev_enumerate_scan_devices(tty_enum);
-
-                    struct udev_list_entry* tty_devices = udev_enumerate_get_list_entry(tty_enum);
-                    struct udev_list_entry* tty_entry;
-
-                    udev_list_entry_foreach(tty_entry, tty_devices) {
-                        const char* tty_path = udev_list_entry_get_name(tty_entry);
-                        struct udev_device* tty_device = udev_device_new_from_syspath(udev, tty_path);
-
-                        const char* tty_parent_path = udev_device_get_syspath(udev_device_get_parent(tty_device));
-
-                        if (tty_parent_path && std::strstr(tty_parent_path, path)) {
-                            const char* tty_node = udev_device_get_devnode(tty_device);
-                            if (tty_node) {
-                                std::cout << "Associated tty device: " << tty_node << std::endl;
-                            }
+                const char* interfaces = udev_device_get_property_value(device, "ID_USB_INTERFACES");
+                print_usb_interfaces(std::cout, interfaces ? interfaces : "");
+                if (is_cdc_device(dev_class, interfaces ? interfaces : "")) {
+                    if (!tty_map_built) {
+                        tty_map.build();
+                        tty_map_built = true;
+                    }
+                    const std::vector<TtyNode>* ttys = tty_map.find(path);
+                    if (ttys) {
+                        for (const auto& tty : *ttys) {
+                            std::cout << "Associated tty device: " << tty.devnode << std::endl;
                         }
-                        udev_device_unref(tty_device);
                     }
-                    udev_enumerate_unref(tty_enum);
                 }
             } else {
                 std::cout << "No USB class information available." << std::endl;
             }
             std::cout << "-----------------------" << std::endl;
         }
-        udev_device_unref(device);
     }
-    udev_enumerate_unref(enumerate);
-    udev_unref(udev);
 }
+
+struct USBIndexEntry {
+    std::string syspath;
+    std::string vendor_id;
+    std::string product_id;
+    std::string devnode;
+    std::string device_class;
+    std::string interfaces;
+    bool cdc = false;
+    std::vector<std::string> tty_nodes;
+};
+
+// vendor:product -> USB devices and their tty children, built from one
+// enumeration and then kept current from udev events. Queries never touch sysfs.
+class USBDeviceIndex {
+public:
+    void rebuild();
+    void apply_event(const UeventView& event);
+    std::string query(const std::string& vendor_id, const std::string& product_id) const;
+    size_t size() const { return devices_.size(); }
+
+private:
+    void insert_device(USBIndexEntry entry);
+    void remove_device(const std::string& syspath);
+    void add_tty(const std::string& tty_syspath, const std::string& usb_syspath, const std::string& devnode);
+    void remove_tty(const std::string& tty_syspath);
+    const std::string* find_usb_ancestor(const std::string& syspath) const;
+
+    TtyParentMap tty_map_;
+    std::unordered_map<std::string, USBIndexEntry> devices_;            // usb_device syspath -> entry
+    std::unordered_map<std::string, std::vector<std::string>> by_id_;   // vendor:product -> syspaths
+    std::unordered_map<std::string, std::pair<std::string, std::string>> ttys_; // tty syspath -> (usb syspath, devnode)
+};
+
+void USBDeviceIndex::insert_device(USBIndexEntry entry) {
+    remove_device(entry.syspath);
+    by_id_[usb_id_key(entry.vendor_id, entry.product_id)].push_back(entry.syspath);
+    std::string syspath = entry.syspath;
+    devices_[syspath] = std::move(entry);
+}
+
+void USBDeviceIndex::remove_device(const std::string& syspath) {
+    auto it = devices_.find(syspath);
+    if (it == devices_.end()) {
+        return;
+    }
+    auto ids = by_id_.find(usb_id_key(it->second.vendor_id, it->second.product_id));
+    if (ids != by_id_.end()) {
+        auto& paths = ids->second;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (paths[i] == syspath) {
+                paths.erase(paths.begin() + i);
+                break;
+            }
+        }
+        if (paths.empty()) {
+            by_id_.erase(ids);
+        }
+    }
+    for (auto tty = ttys_.begin(); tty != ttys_.end();) {
+        tty = tty->second.first == syspath ? ttys_.erase(tty) : std::next(tty);
+    }
+    devices_.erase(it);
+}
+
+void USBDeviceIndex::add_tty(const std::string& tty_syspath, const std::string& usb_syspath, const std::string& devnode) {
+    auto it = devices_.find(usb_syspath);
+    if (it == devices_.end() || devnode.empty()) {
+        return;
+    }
+    remove_tty(tty_syspath);
+    it->second.tty_nodes.push_back(devnode);
+    ttys_[tty_syspath] = std::make_pair(usb_syspath, devnode);
+}
+
+void USBDeviceIndex::remove_tty(const std::string& tty_syspath) {
+    auto tty = ttys_.find(tty_syspath);
+    if (tty == ttys_.end()) {
+        return;
+    }
+    auto it = devices_.find(tty->second.first);
+    if (it != devices_.end()) {
+        auto& nodes = it->second.tty_nodes;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i] == tty->second.second) {
+                nodes.erase(nodes.begin() + i);
+                break;
+            }
+        }
+    }
+    ttys_.erase(tty);
+}
+
+// A tty hangs below its USB device in the sysfs tree, so its closest indexed
+// ancestor is found by trimming path components.
+const std::string* USBDeviceIndex::find_usb_ancestor(const std::string& syspath) const {
+    std::string path = syspath;
+    size_t slash;
+    while ((slash = path.rfind('/')) != std::string::npos && slash > 0) {
+        path.resize(slash);
+        auto it = devices_.find(path);
+        if (it != devices_.end()) {
+            return &it->first;
+        }
+    }
+    return nullptr;
+}
+
+void USBDeviceIndex::rebuild() {
+    devices_.clear();
+    by_id_.clear();
+    ttys_.clear();
+
+    UdevEnumeratePtr enumerate = scan_subsystem("usb", "DEVTYPE", "usb_device");
+    if (!enumerate) {
+        return;
+    }
+
+    struct udev_list_entry* entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate.get())) {
+        const char* path = udev_list_entry_get_name(entry);
+        UdevDevicePtr handle(udev_device_new_from_syspath(udev_context(), path));
+        if (!handle) {
+            continue;
+        }
+        struct udev_device* device = handle.get();
+        const char* dev_vendor = udev_device_get_sysattr_value(device, "idVendor");
+        const char* dev_product = udev_device_get_sysattr_value(device, "idProduct");
+        if (dev_vendor && dev_product) {
+            USBIndexEntry index_entry;
+            index_entry.syspath = path;
+            index_entry.vendor_id = dev_vendor;
+            index_entry.product_id = dev_product;
+            const char* dev_node = udev_device_get_devnode(device);
+            const char* dev_class = udev_device_get_sysattr_value(device, "bDeviceClass");
+            index_entry.devnode = dev_node ? dev_node : "";
+            index_entry.device_class = dev_class ? dev_class : "";
+            const char* interfaces = udev_device_get_property_value(device, "ID_USB_INTERFACES");
+            index_entry.interfaces = interfaces ? interfaces : "";
+            index_entry.cdc = is_cdc_device(index_entry.device_class, index_entry.interfaces);
+            insert_device(std::move(index_entry));
+        }
+    }
+
+    tty_map_.build();
+    for (const auto& device : devices_) {
+        const std::vector<TtyNode>* ttys = tty_map_.find(device.first);
+        if (ttys) {
+            for (const auto& tty : *ttys) {
+                add_tty(tty.syspath, device.first, tty.devnode);
+            }
+        }
+    }
+}
+
+// Kernel TYPE is "bDeviceClass/bDeviceSubClass/bDeviceProtocol" in decimal.
+static std::string class_from_type(std::string_view type) {
+    unsigned value = 0;
+    size_t i = 0;
+    for (; i < type.size() && std::isdigit(static_cast<unsigned char>(type[i])); ++i) {
+        value = value * 10 + (type[i] - '0');
+    }
+    if (i == 0 || value > 0xff) {
+        return std::string();
+    }
+    char hex[3];
+    std::snprintf(hex, sizeof(hex), "%02x", value);
+    return hex;
+}
+
+// Kernel PRODUCT is "idVendor/idProduct/bcdDevice" in hex without padding.
+static void ids_from_product(std::string_view product, std::string& vendor_id, std::string& product_id) {
+    size_t first = product.find('/');
+    size_t second = first == std::string_view::npos ? first : product.find('/', first + 1);
+    if (second == std::string_view::npos) {
+        return;
+    }
+    std::string vendor(product.substr(0, first));
+    std::string model(product.substr(first + 1, second - first - 1));
+    vendor_id = std::string(vendor.size() < 4 ? 4 - vendor.size() : 0, '0') + vendor;
+    product_id = std::string(model.size() < 4 ? 4 - model.size() : 0, '0') + model;
+}
+
+void USBDeviceIndex::apply_event(const UeventView& event) {
+    std::string_view action = event.get(UeventKey::Action);
+    std::string_view devpath = event.get(UeventKey::Devpath);
+    if (action.empty() || devpath.empty()) {
+        return;
+    }
+    std::string syspath = "/sys" + std::string(devpath);
+    std::string_view subsystem = event.get(UeventKey::Subsystem);
+
+    if (subsystem == "usb") {
+        if (event.get(UeventKey::Devtype) != "usb_device") {
+            return;
+        }
+        if (action == "remove") {
+            remove_device(syspath);
+            return;
+        }
+        if (action != "add" && action != "change") {
+            return;
+        }
+
+        USBIndexEntry entry;
+        entry.syspath = syspath;
+        ids_from_product(event.get(UeventKey::Product), entry.vendor_id, entry.product_id);
+        entry.devnode = std::string(event.get(UeventKey::Devname));
+        entry.device_class = class_from_type(event.get("TYPE"));
+        entry.interfaces = std::string(event.get("ID_USB_INTERFACES"));
+        entry.cdc = is_cdc_device(entry.device_class, entry.interfaces);
+        if (entry.vendor_id.empty()) {
+            return;
+        }
+
+        // Keep the attached ttys when a known device is only refreshed.
+        auto existing = devices_.find(syspath);
+        if (existing != devices_.end() && existing->second.vendor_id == entry.vendor_id &&
+            existing->second.product_id == entry.product_id) {
+            existing->second.devnode = entry.devnode;
+            existing->second.device_class = entry.device_class;
+            existing->second.interfaces = entry.interfaces;
+            existing->second.cdc = entry.cdc;
+            return;
+        }
+        insert_device(std::move(entry));
+    } else if (subsystem == "tty") {
+        if (action == "remove") {
+            remove_tty(syspath);
+        } else if (action == "add") {
+            const std::string* usb_syspath = find_usb_ancestor(syspath);
+            if (usb_syspath) {
+                add_tty(syspath, *usb_syspath, std::string(event.get(UeventKey::Devname)));
+            }
+        }
+    }
+}
+
+std::string USBDeviceIndex::query(const std::string& vendor_id, const std::string& product_id) const {
+    std::ostringstream out;
+    auto ids = by_id_.find(usb_id_key(vendor_id, product_id));
+    if (ids == by_id_.end()) {
+        out << "No matching USB device." << std::endl;
+        return out.str();
+    }
+
+    for (const auto& syspath : ids->second) {
+        const USBIndexEntry& entry = devices_.at(syspath);
+        out << "Found matching USB device!" << std::endl;
+        if (!entry.devnode.empty()) {
+            out << "Device Node under /dev: " << entry.devnode << std::endl;
+        } else {
+            out << "No /dev node associated with this device." << std::endl;
+        }
+        if (!entry.device_class.empty()) {
+            out << "USB Device Class (" << entry.device_class << "): "
+                << get_usb_class_description(entry.device_class) << std::endl;
+            print_usb_interfaces(out, entry.interfaces);
+            if (entry.cdc) {
+                for (const auto& tty_node : entry.tty_nodes) {
+                    out << "Associated tty device: " << tty_node << std::endl;
+                }
+            }
+        } else {
+            out << "No USB class information available." << std::endl;
+        }
+        out << "-----------------------" << std::endl;
+    }
+    return out.str();
+}
+
+static bool make_socket_address(const std::string& socket_path, struct sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << socket_path << std::endl;
+        return false;
+    }
+    std::strcpy(addr.sun_path, socket_path.c_str());
+    return true;
+}
+
+// Request: "<vendor>:<product>". Reply: the same report the one-shot mode prints.
+// The client fd is non-blocking; returns false while the request has not
+// arrived yet, true once the client is done with and can be closed.
+static bool serve_query(int client_fd, const USBDeviceIndex& index) {
+    char request[128];
+    ssize_t length = recv(client_fd, request, sizeof(request) - 1, 0);
+    if (length < 0) {
+        return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    }
+    if (length == 0) {
+        return true;
+    }
+    request[length] = '\0';
+
+    std::string reply;
+    char* colon = std::strchr(request, ':');
+    if (!colon) {
+        reply = "Invalid request, expected <Vendor ID>:<Product ID>\n";
+    } else {
+        *colon = '\0';
+        reply = index.query(request, colon + 1);
+    }
+    if (reply.size() > QUERY_BUFFER_SIZE) {
+        reply.resize(QUERY_BUFFER_SIZE);
+    }
+    send(client_fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+    return true;
+}
+
+static bool watch_fd(int epoll_fd, int fd) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+int run_daemon(const std::string& socket_path) {
+    struct udev* udev = udev_context();
+    if (!udev) {
+        return 1;
+    }
+
+    USBDeviceIndex index;
+    UeventMonitorOptions options;
+    options.overflow_callback = [&index]() {
+        index.rebuild();
+    };
+
+    // Subscribe before the initial scan so no hotplug event falls in between.
+    UdevMonitor monitor;
+    if (!monitor.open(udev, {{"usb", "usb_device"}, {"tty", ""}}, options)) {
+        return 1;
+    }
+    index.rebuild();
+    std::cout << "Indexed " << index.size() << " USB devices" << std::endl;
+
+    struct sockaddr_un addr;
+    if (!make_socket_address(socket_path, addr)) {
+        return 1;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+        std::cerr << "Failed to listen on " << socket_path << ": " << strerror(errno) << std::endl;
+        close(listen_fd);
+        return 1;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0 || !watch_fd(epoll_fd, monitor.fd()) || !watch_fd(epoll_fd, listen_fd)) {
+        std::cerr << "Failed to set up epoll: " << strerror(errno) << std::endl;
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        return 1;
+    }
+
+    UeventBatchCallback on_events = [&index](const UeventView* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            index.apply_event(events[i]);
+        }
+    };
+    monitor.drain(on_events);
+
+    std::cout << "Serving queries on " << socket_path << std::endl;
+    struct epoll_event events[10];
+    while (true) {
+        int num_events = epoll_wait(epoll_fd, events, 10, -1);
+        if (num_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error in epoll_wait" << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < num_events; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                // Clients are served once readable, so a silent one cannot
+                // hold up hotplug handling or other queries.
+                int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (client_fd >= 0 && (serve_query(client_fd, index) || !watch_fd(epoll_fd, client_fd))) {
+                    close(client_fd);
+                }
+            } else if (fd == monitor.fd()) {
+                monitor.drain(on_events);
+            } else if (serve_query(fd, index)) {
+                close(fd);
+            }
+        }
+    }
+
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    return 1;
+}
+
+int run_query(const std::string& vendor_id, const std::string& product_id, const std::string& socket_path) {
+    struct sockaddr_un addr;
+    if (!make_socket_address(socket_path, addr)) {
+        return 1;
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "Cannot reach DevInfoColl daemon at " << socket_path << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+
+    std::string request = vendor_id + ":" + product_id;
+    std::vector<char> reply(QUERY_BUFFER_SIZE);
+    ssize_t length = -1;
+    if (send(fd, request.data(), request.size(), 0) >= 0) {
+        length = recv(fd, reply.data(), reply.size(), 0);
+    }
+    close(fd);
+    if (length < 0) {
+        std::cerr << "Query failed: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout.write(reply.data(), length);
+    return 0;
+}
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <Vendor ID> <Product ID>" << std::endl;
+    std::cerr << "       " << program << " --daemon [socket path]" << std::endl;
+    std::cerr << "       " << program << " --query <Vendor ID> <Product ID> [socket path]" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::strcmp(argv[1], "--daemon") == 0 && argc <= 3) {
+        return run_daemon(argc == 3 ? argv[2] : DEFAULT_SOCKET_PATH);
+    }
+    if (argc >= 4 && std::strcmp(argv[1], "--query") == 0 && argc <= 5) {
+        return run_query(argv[2], argv[3], argc == 5 ? argv[4] : DEFAULT_SOCKET_PATH);
+    }
     if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <Vendor ID> <Product ID>" << std::endl;
+        print_usage(argv[0]);
         return 1;
     }
 
@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../common/uevent.h"
+
+// Counts every heap allocation so the report can show mallocs per event.
+static size_t allocation_count = 0;
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+// The parser Collector and MavRunner used before common/uevent.h.
+std::map<std::string, std::string> legacy_parse_event_data(const char* buffer, ssize_t length) {
+    std::map<std::string, std::string> event_data;
+
+    for (const char* ptr = buffer; ptr < buffer + length; ptr += strlen(ptr) + 1) {
+        std::string entry(ptr);
+        size_t equal_pos = entry.find('=');
+
+        if (equal_pos != std::string::npos) {
+            std::string key = entry.substr(0, equal_pos);
+            std::string value = entry.substr(equal_pos + 1);
+            event_data[key] = value;
+        }
+    }
+
+    return event_data;
+}
+
+static std::string make_event(const std::vector<std::string>& entries) {
+    std::string buffer;
+    for (const auto& entry : entries) {
+        buffer += entry;
+        buffer += '\0';
+    }
+    return buffer;
+}
+
+struct Sample {
+    const char* name;
+    std::string buffer;
+};
+
+template <typename Fn>
+static void run(const char* label, const Sample& sample, size_t iterations, Fn fn) {
+    size_t allocations_before = allocation_count;
+    auto start = std::chrono::steady_clock::now();
+    size_t sink = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += fn(sample.buffer.data(), sample.buffer.size());
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    size_t allocations = allocation_count - allocations_before;
+
+    std::cout << sample.name << " / " << label << ": "
+              << elapsed / iterations << " ns/event, "
+              << static_cast<double>(allocations) / iterations << " allocs/event"
+              << " (checksum " << sink << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+
+    std::vector<Sample> samples = {
+        {"kernel usb add", make_event({
+            "add@/devices/pci0000:00/0000:00:14.0/usb1/1-2",
+            "ACTION=add",
+            "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2",
+            "SUBSYSTEM=usb",
+            "MAJOR=189",
+            "MINOR=3",
+            "DEVNAME=bus/usb/001/004",
+            "DEVTYPE=usb_device",
+            "PRODUCT=46d/c52b/1211",
+            "TYPE=0/0/0",
+            "BUSNUM=001",
+            "DEVNUM=004",
+            "SEQNUM=4521",
+        })},
+        {"udev usb add", make_event({
+            "ACTION=add",
+            "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2",
+            "SUBSYSTEM=usb",
+            "DEVNAME=/dev/bus/usb/001/004",
+            "DEVTYPE=usb_device",
+            "PRODUCT=46d/c52b/1211",
+            "TYPE=0/0/0",
+            "BUSNUM=001",
+            "DEVNUM=004",
+            "SEQNUM=4521",
+            "USEC_INITIALIZED=91234567",
+            "ID_VENDOR=Logitech",
+            "ID_VENDOR_ENC=Logitech",
+            "ID_VENDOR_ID=046d",
+            "ID_MODEL=USB_Receiver",
+            "ID_MODEL_ENC=USB\\x20Receiver",
+            "ID_MODEL_ID=c52b",
+            "ID_REVISION=1211",
+            "ID_SERIAL=Logitech_USB_Receiver",
+            "ID_BUS=usb",
+            "ID_USB_INTERFACES=:030101:030102:030000:",
+            "ID_VENDOR_FROM_DATABASE=Logitech, Inc.",
+            "ID_MODEL_FROM_DATABASE=Unifying Receiver",
+            "ID_PATH=pci-0000:00:14.0-usb-0:2",
+            "ID_PATH_TAG=pci-0000_00_14_0-usb-0_2",
+            "DRIVER=usb",
+            "MAJOR=189",
+            "MINOR=3",
+        })},
+    };
+
+    for (const Sample& sample : samples) {
+        run("std::map parser", sample, iterations, [](const char* buffer, size_t length) {
+            std::map<std::string, std::string> event_data = legacy_parse_event_data(buffer, length);
+            auto subsystem = event_data.find("SUBSYSTEM");
+            auto vendor = event_data.find("ID_VENDOR_ID");
+            return (subsystem != event_data.end() ? subsystem->second.size() : 0) +
+                   (vendor != event_data.end() ? vendor->second.size() : 0);
+        });
+
+        run("UeventView parser", sample, iterations, [](const char* buffer, size_t length) {
+            UeventView event;
+            parse_uevent(buffer, length, event);
+            return event.get(UeventKey::Subsystem).size() + event.get(UeventKey::IdVendorId).size();
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include "udev_handle.h"
+
+#include <iostream>
+
+struct udev* udev_context() {
+    static UdevPtr context(udev_new());
+    static bool reported = false;
+    if (!context && !reported) {
+        std::cerr << "Cannot create udev context" << std::endl;
+        reported = true;
+    }
+    return context.get();
+}
+
+UdevEnumeratePtr scan_subsystem(const char* subsystem, const char* property, const char* value) {
+    struct udev* udev = udev_context();
+    if (!udev) {
+        return UdevEnumeratePtr();
+    }
+
+    UdevEnumeratePtr enumerate(udev_enumerate_new(udev));
+    if (!enumerate) {
+        std::cerr << "Cannot create udev enumerate" << std::endl;
+        return enumerate;
+    }
+    udev_enumerate_add_match_subsystem(enumerate.get(), subsystem);
+    if (property) {
+        udev_enumerate_add_match_property(enumerate.get(), property, value);
+    }
+    udev_enumerate_scan_devices(enumerate.get());
+    return enumerate;
+}
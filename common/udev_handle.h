@@ -0,0 +1,28 @@
+#ifndef UDEV_HANDLE_H
+#define UDEV_HANDLE_H
+
+#include <libudev.h>
+#include <memory>
+
+// Owning handles for libudev objects; the deleter drops one reference.
+struct UdevUnref {
+    void operator()(struct udev* udev) const { udev_unref(udev); }
+    void operator()(struct udev_enumerate* enumerate) const { udev_enumerate_unref(enumerate); }
+    void operator()(struct udev_device* device) const { udev_device_unref(device); }
+    void operator()(struct udev_monitor* monitor) const { udev_monitor_unref(monitor); }
+};
+
+using UdevPtr = std::unique_ptr<struct udev, UdevUnref>;
+using UdevEnumeratePtr = std::unique_ptr<struct udev_enumerate, UdevUnref>;
+using UdevDevicePtr = std::unique_ptr<struct udev_device, UdevUnref>;
+using UdevMonitorPtr = std::unique_ptr<struct udev_monitor, UdevUnref>;
+
+// Process-wide udev context, created on first use and shared by every
+// enumeration and monitor in the process. Returns nullptr if libudev could
+// not be initialised.
+struct udev* udev_context();
+
+// Enumerates one subsystem (optionally narrowed by a property match).
+UdevEnumeratePtr scan_subsystem(const char* subsystem, const char* property = nullptr, const char* value = nullptr);
+
+#endif // UDEV_HANDLE_H
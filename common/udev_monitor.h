@@ -0,0 +1,144 @@
+#ifndef UDEV_MONITOR_H
+#define UDEV_MONITOR_H
+
+#include <libudev.h>
+#include <cerrno>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "udev_handle.h"
+#include "uevent_monitor.h"
+
+// Subsystem (and optionally devtype) that udevd should forward to us.
+struct UdevMatch {
+    std::string subsystem;
+    std::string devtype;
+};
+
+// Copies a device's properties into a view. The view points into the
+// device's own storage and is valid until the device is unreferenced.
+inline void udev_device_to_view(struct udev_device* device, UeventView& view) {
+    view.clear();
+    struct udev_list_entry* entry;
+    udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(device)) {
+        const char* name = udev_list_entry_get_name(entry);
+        const char* value = udev_list_entry_get_value(entry);
+        view.add(name, value ? value : "");
+    }
+}
+
+inline bool action_allowed(const UeventFilter& filter, std::string_view action) {
+    if (filter.actions.empty()) {
+        return true;
+    }
+    for (const auto& allowed : filter.actions) {
+        if (action == allowed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// udevd event source for callers that run their own poll loop. Events are
+// re-broadcast by udevd after rule processing, so they carry the ID_*
+// properties the raw kernel stream lacks. Subsystem/devtype matching is done
+// by libudev's own socket filter; options.filter.actions is applied here. The
+// udev context is borrowed and must outlive the monitor; udev_context() does.
+class UdevMonitor {
+public:
+    bool open(struct udev* udev, const std::vector<UdevMatch>& matches,
+              const UeventMonitorOptions& options = UeventMonitorOptions()) {
+        monitor_.reset(udev_monitor_new_from_netlink(udev, "udev"));
+        if (!monitor_) {
+            std::cerr << "Cannot create udev monitor" << std::endl;
+            return false;
+        }
+
+        for (const auto& match : matches) {
+            if (udev_monitor_filter_add_match_subsystem_devtype(monitor_.get(), match.subsystem.c_str(),
+                    match.devtype.empty() ? nullptr : match.devtype.c_str()) < 0) {
+                std::cerr << "Failed to add udev monitor match for " << match.subsystem << std::endl;
+            }
+        }
+
+        if (options.receive_buffer_size > 0) {
+            udev_monitor_set_receive_buffer_size(monitor_.get(), options.receive_buffer_size);
+        }
+
+        if (udev_monitor_enable_receiving(monitor_.get()) < 0) {
+            std::cerr << "Failed to enable udev monitor" << std::endl;
+            monitor_.reset();
+            return false;
+        }
+
+        options_ = options;
+        const size_t capacity = options.batch_size ? options.batch_size : 1;
+        devices_.resize(capacity);
+        views_.resize(capacity);
+        return true;
+    }
+
+    int fd() const { return monitor_ ? udev_monitor_get_fd(monitor_.get()) : -1; }
+
+    // Delivers everything queued on the (non-blocking) socket in batches.
+    bool drain(const UeventBatchCallback& callback) {
+        const size_t capacity = devices_.size();
+        while (true) {
+            size_t count = 0;
+            bool drained = false;
+            while (count < capacity) {
+                errno = 0;
+                struct udev_device* device = udev_monitor_receive_device(monitor_.get());
+                if (!device) {
+                    if (errno == ENOBUFS) {
+                        std::cerr << "Udev monitor overflow, events were dropped" << std::endl;
+                        if (options_.overflow_callback) {
+                            options_.overflow_callback();
+                        }
+                        continue;
+                    }
+                    drained = true;
+                    break;
+                }
+                udev_device_to_view(device, views_[count]);
+                if (!action_allowed(options_.filter, views_[count].get(UeventKey::Action))) {
+                    udev_device_unref(device);
+                    continue;
+                }
+                devices_[count++] = device;
+            }
+
+            if (count > 0) {
+                callback(views_.data(), count);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                udev_device_unref(devices_[i]);
+            }
+            if (drained) {
+                return true;
+            }
+        }
+    }
+
+private:
+    UdevMonitorPtr monitor_;
+    UeventMonitorOptions options_;
+    std::vector<struct udev_device*> devices_;
+    std::vector<UeventView> views_;
+};
+
+inline void monitor_udev_events(struct udev* udev, const std::vector<UdevMatch>& matches,
+                                const UeventBatchCallback& callback,
+                                const UeventMonitorOptions& options = UeventMonitorOptions()) {
+    UdevMonitor monitor;
+    if (!monitor.open(udev, matches, options)) {
+        return;
+    }
+
+    run_edge_triggered_loop(monitor.fd(), [&]() {
+        return monitor.drain(callback);
+    });
+}
+
+#endif // UDEV_MONITOR_H
@@ -0,0 +1,165 @@
+#ifndef UEVENT_H
+#define UEVENT_H
+
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+// Keys the collectors actually read. Their values are cached in fixed slots
+// while parsing so a lookup is an array index instead of a string search.
+enum class UeventKey : unsigned char {
+    Action,
+    Subsystem,
+    Devpath,
+    DevpathOld,
+    Devtype,
+    Devname,
+    Driver,
+    Product,
+    Seqnum,
+    IdVendorId,
+    IdModelId,
+    IdVendor,
+    IdModel,
+    Count
+};
+
+struct UeventField {
+    std::string_view key;
+    std::string_view value;
+};
+
+// Flat, fixed-capacity view of one uevent. Keys and values point into the
+// buffer that was parsed, so the view must not outlive it.
+class UeventView {
+public:
+    static constexpr size_t kMaxFields = 64;
+
+    void clear() {
+        count_ = 0;
+        truncated_ = false;
+        for (auto& value : known_) {
+            value = std::string_view();
+        }
+    }
+
+    bool add(std::string_view key, std::string_view value) {
+        if (count_ == kMaxFields) {
+            truncated_ = true;
+            return false;
+        }
+        fields_[count_++] = UeventField{key, value};
+        int slot = known_slot(key);
+        if (slot >= 0) {
+            known_[slot] = value;
+        }
+        return true;
+    }
+
+    // A present key with an empty value returns a non-null empty view.
+    std::string_view get(UeventKey key) const { return known_[static_cast<size_t>(key)]; }
+    bool has(UeventKey key) const { return get(key).data() != nullptr; }
+
+    std::string_view get(std::string_view key) const {
+        int slot = known_slot(key);
+        if (slot >= 0) {
+            return known_[slot];
+        }
+        for (size_t i = count_; i-- > 0;) {
+            if (fields_[i].key == key) {
+                return fields_[i].value;
+            }
+        }
+        return std::string_view();
+    }
+
+    const UeventField* begin() const { return fields_; }
+    const UeventField* end() const { return fields_ + count_; }
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool truncated() const { return truncated_; }
+
+    static int known_slot(std::string_view key) {
+        switch (key.size()) {
+        case 6:
+            if (key == "ACTION") return static_cast<int>(UeventKey::Action);
+            if (key == "DRIVER") return static_cast<int>(UeventKey::Driver);
+            if (key == "SEQNUM") return static_cast<int>(UeventKey::Seqnum);
+            break;
+        case 7:
+            if (key == "DEVPATH") return static_cast<int>(UeventKey::Devpath);
+            if (key == "DEVTYPE") return static_cast<int>(UeventKey::Devtype);
+            if (key == "DEVNAME") return static_cast<int>(UeventKey::Devname);
+            if (key == "PRODUCT") return static_cast<int>(UeventKey::Product);
+            break;
+        case 8:
+            if (key == "ID_MODEL") return static_cast<int>(UeventKey::IdModel);
+            break;
+        case 9:
+            if (key == "SUBSYSTEM") return static_cast<int>(UeventKey::Subsystem);
+            if (key == "ID_VENDOR") return static_cast<int>(UeventKey::IdVendor);
+            break;
+        case 11:
+            if (key == "DEVPATH_OLD") return static_cast<int>(UeventKey::DevpathOld);
+            if (key == "ID_MODEL_ID") return static_cast<int>(UeventKey::IdModelId);
+            break;
+        case 12:
+            if (key == "ID_VENDOR_ID") return static_cast<int>(UeventKey::IdVendorId);
+            break;
+        }
+        return -1;
+    }
+
+private:
+    UeventField fields_[kMaxFields];
+    size_t count_ = 0;
+    std::string_view known_[static_cast<size_t>(UeventKey::Count)];
+    bool truncated_ = false;
+};
+
+// Parses KEY=VALUE entries split by separator. Entries without '=' (such as
+// the kernel's "action@devpath" header) are skipped. Never allocates.
+inline void parse_key_values(const char* buffer, size_t length, char separator, UeventView& out) {
+    out.clear();
+    const char* ptr = buffer;
+    const char* end = buffer + length;
+    while (ptr < end) {
+        const char* sep = static_cast<const char*>(std::memchr(ptr, separator, end - ptr));
+        const char* entry_end = sep ? sep : end;
+        const char* equal = static_cast<const char*>(std::memchr(ptr, '=', entry_end - ptr));
+        if (equal) {
+            out.add(std::string_view(ptr, equal - ptr), std::string_view(equal + 1, entry_end - equal - 1));
+        }
+        ptr = entry_end + 1;
+    }
+}
+
+// Netlink uevents separate entries with NUL.
+inline void parse_uevent(const char* buffer, size_t length, UeventView& out) {
+    parse_key_values(buffer, length, '\0', out);
+}
+
+// sysfs "uevent" attribute files hold the same entries one per line.
+inline void parse_uevent_file(const char* buffer, size_t length, UeventView& out) {
+    parse_key_values(buffer, length, '\n', out);
+}
+
+// Owning copy of a view, for consumers that keep event data past the callback.
+inline std::map<std::string, std::string> parse_event_data(const UeventView& view) {
+    std::map<std::string, std::string> event_data;
+    for (const UeventField& field : view) {
+        event_data[std::string(field.key)] = std::string(field.value);
+    }
+    return event_data;
+}
+
+inline std::map<std::string, std::string> parse_event_data(const char* buffer, ssize_t length) {
+    UeventView view;
+    parse_uevent(buffer, length < 0 ? 0 : static_cast<size_t>(length), view);
+    return parse_event_data(view);
+}
+
+#endif // UEVENT_H
@@ -0,0 +1,166 @@
+#ifndef UEVENT_FILTER_H
+#define UEVENT_FILTER_H
+
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Allowlist applied in the kernel to raw NETLINK_KOBJECT_UEVENT datagrams.
+// An empty list accepts everything for that field.
+struct UeventFilter {
+    std::vector<std::string> subsystems;
+    std::vector<std::string> actions;
+
+    bool empty() const { return subsystems.empty() && actions.empty(); }
+};
+
+// Kernel uevents are laid out as
+//   "<action>@<devpath>\0ACTION=<action>\0DEVPATH=<devpath>\0SUBSYSTEM=<subsystem>\0..."
+// so with h = strlen("<action>@<devpath>") the SUBSYSTEM entry starts at 2h + 17.
+// Classic BPF has no backward jumps, so the header NUL is found by an unrolled
+// scan of the first kUeventFilterScanLimit bytes. Anything that does not match
+// this layout is accepted and left to the userspace check.
+static const uint32_t kUeventFilterScanLimit = 512;
+static const size_t kUeventFilterMaxName = 64;
+static const uint32_t kUeventFilterAccept = 0xffffffff;
+static const uint32_t kUeventFilterDrop = 0;
+
+namespace uevent_filter_detail {
+
+inline struct sock_filter stmt(uint16_t code, uint32_t k) {
+    return BPF_STMT(code, k);
+}
+
+inline struct sock_filter jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+    return BPF_JUMP(code, k, jt, jf);
+}
+
+inline size_t match_length(size_t bytes) {
+    size_t chunks = bytes / 4 + (bytes % 4) / 2 + (bytes % 2);
+    return chunks * 2;
+}
+
+// Emits loads and compares of `bytes` at `offset` (absolute, or relative to X
+// when `indirect`). A full match falls through to the instruction the caller
+// appends after the block; any mismatch skips over that instruction.
+inline void append_match(std::vector<struct sock_filter>& prog, bool indirect, uint32_t offset, const std::string& bytes) {
+    const uint16_t mode = indirect ? BPF_IND : BPF_ABS;
+    const size_t block_end = prog.size() + match_length(bytes.size());
+    size_t pos = 0;
+    while (pos < bytes.size()) {
+        size_t width = bytes.size() - pos >= 4 ? 4 : (bytes.size() - pos >= 2 ? 2 : 1);
+        uint16_t size = width == 4 ? BPF_W : (width == 2 ? BPF_H : BPF_B);
+        uint32_t value = 0;
+        for (size_t i = 0; i < width; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(bytes[pos + i]);
+        }
+        prog.push_back(stmt(BPF_LD | size | mode, offset + pos));
+        uint8_t skip = static_cast<uint8_t>(block_end - prog.size());
+        prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, value, 0, skip));
+        pos += width;
+    }
+}
+
+} // namespace uevent_filter_detail
+
+// Builds the filter program. Returns an empty program when there is nothing to
+// filter or a name is too long to compare.
+inline std::vector<struct sock_filter> build_uevent_filter_program(const UeventFilter& filter) {
+    using namespace uevent_filter_detail;
+    std::vector<struct sock_filter> prog;
+    if (filter.empty()) {
+        return prog;
+    }
+
+    size_t longest_subsystem = 0;
+    for (const auto& name : filter.subsystems) {
+        if (name.empty() || name.size() > kUeventFilterMaxName) {
+            return prog;
+        }
+        longest_subsystem = std::max(longest_subsystem, name.size());
+    }
+    for (const auto& name : filter.actions) {
+        if (name.empty() || name.size() > kUeventFilterMaxName) {
+            return prog;
+        }
+    }
+
+    // Step 1: The action prefixes the header, so it is matched at offset 0.
+    if (!filter.actions.empty()) {
+        for (const auto& action : filter.actions) {
+            const std::string header = action + "@";
+            append_match(prog, false, 0, header);
+            prog.push_back(stmt(BPF_JMP | BPF_JA, 0)); // patched to the subsystem stage
+        }
+        prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterDrop));
+        for (size_t i = 0; i < prog.size(); ++i) {
+            if (prog[i].code == (BPF_JMP | BPF_JA)) {
+                prog[i].k = static_cast<uint32_t>(prog.size() - i - 1);
+            }
+        }
+    }
+
+    if (filter.subsystems.empty()) {
+        prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterAccept));
+        return prog;
+    }
+
+    // Step 2: Find the NUL ending the header; X = header length.
+    const size_t scan_start = prog.size();
+    const size_t scan_end = scan_start + kUeventFilterScanLimit * 4 + 1;
+    for (uint32_t k = 0; k < kUeventFilterScanLimit; ++k) {
+        prog.push_back(stmt(BPF_LD | BPF_B | BPF_ABS, k));
+        prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 2));
+        prog.push_back(stmt(BPF_LDX | BPF_W | BPF_IMM, k));
+        prog.push_back(stmt(BPF_JMP | BPF_JA, static_cast<uint32_t>(scan_end - prog.size() - 1)));
+    }
+    prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterAccept)); // header longer than the scan
+
+    // Step 3: X = offset of "SUBSYSTEM=", stashed in M[0]. Accept packets too
+    // short to hold the longest comparison rather than letting a load fault.
+    prog.push_back(stmt(BPF_MISC | BPF_TXA, 0));
+    prog.push_back(stmt(BPF_ALU | BPF_LSH | BPF_K, 1));
+    prog.push_back(stmt(BPF_ALU | BPF_ADD | BPF_K, 17));
+    prog.push_back(stmt(BPF_ST, 0));
+    prog.push_back(stmt(BPF_ALU | BPF_ADD | BPF_K, static_cast<uint32_t>(10 + longest_subsystem + 1)));
+    prog.push_back(stmt(BPF_MISC | BPF_TAX, 0));
+    prog.push_back(stmt(BPF_LD | BPF_W | BPF_LEN, 0));
+    prog.push_back(jump(BPF_JMP | BPF_JGE | BPF_X, 0, 1, 0));
+    prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterAccept));
+    prog.push_back(stmt(BPF_LDX | BPF_W | BPF_MEM, 0));
+
+    append_match(prog, true, 0, std::string("SUBSYSTEM="));
+    prog.push_back(stmt(BPF_JMP | BPF_JA, 1));
+    prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterAccept)); // unexpected layout
+
+    // Step 4: Compare the value, including its terminating NUL.
+    for (const auto& subsystem : filter.subsystems) {
+        append_match(prog, true, 10, subsystem + std::string(1, '\0'));
+        prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterAccept));
+    }
+    prog.push_back(stmt(BPF_RET | BPF_K, kUeventFilterDrop));
+
+    return prog;
+}
+
+inline bool attach_uevent_filter(int sock_fd, const UeventFilter& filter) {
+    std::vector<struct sock_filter> prog = build_uevent_filter_program(filter);
+    if (prog.empty()) {
+        return filter.empty();
+    }
+
+    struct sock_fprog fprog;
+    fprog.len = static_cast<unsigned short>(prog.size());
+    fprog.filter = prog.data();
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+        std::cerr << "Failed to attach uevent socket filter" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif // UEVENT_FILTER_H
@@ -0,0 +1,258 @@
+#ifndef UEVENT_MONITOR_H
+#define UEVENT_MONITOR_H
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <linux/netlink.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "uevent.h"
+#include "uevent_filter.h"
+
+#define UEVENT_BUFFER_SIZE 2048
+
+using EventCallback = std::function<void(const std::map<std::string, std::string>&)>;
+using UeventCallback = std::function<void(const UeventView&)>;
+using UeventBatchCallback = std::function<void(const UeventView* events, size_t count)>;
+
+struct UeventMonitorOptions {
+    // Requested socket receive buffer. SO_RCVBUFFORCE is tried first so root
+    // can exceed net.core.rmem_max; otherwise the kernel clamps SO_RCVBUF.
+    int receive_buffer_size = 4 * 1024 * 1024;
+    // Number of datagrams drained per recvmmsg call.
+    size_t batch_size = 32;
+    // Called when the kernel reports ENOBUFS, i.e. events were dropped and
+    // any state derived from them should be resynchronised.
+    std::function<void()> overflow_callback;
+    // Optional subsystem/action allowlist compiled to a socket filter, so
+    // unwanted events are dropped in the kernel before they wake us up.
+    UeventFilter filter;
+};
+
+// Pre-allocated receive buffers and parsed views reused for every drain.
+class UeventBatch {
+public:
+    explicit UeventBatch(size_t capacity)
+        : buffers_(capacity * UEVENT_BUFFER_SIZE), iov_(capacity), addrs_(capacity), msgs_(capacity), views_(capacity) {
+        for (size_t i = 0; i < capacity; ++i) {
+            iov_[i].iov_base = &buffers_[i * UEVENT_BUFFER_SIZE];
+            iov_[i].iov_len = UEVENT_BUFFER_SIZE;
+        }
+    }
+
+    // Reads up to capacity() datagrams. Returns the number of parsed events,
+    // or -1 with errno set (EAGAIN once the socket is drained). Skipped
+    // datagrams still count towards last_received().
+    int receive(int sock_fd) {
+        received_ = 0;
+        for (size_t i = 0; i < msgs_.size(); ++i) {
+            std::memset(&msgs_[i], 0, sizeof(msgs_[i]));
+            msgs_[i].msg_hdr.msg_iov = &iov_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+            msgs_[i].msg_hdr.msg_name = &addrs_[i];
+            msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+        }
+
+        int received = recvmmsg(sock_fd, msgs_.data(), msgs_.size(), MSG_DONTWAIT, nullptr);
+        if (received <= 0) {
+            return received;
+        }
+        received_ = static_cast<size_t>(received);
+
+        int count = 0;
+        for (int i = 0; i < received; ++i) {
+            // Only the kernel (port 0) sends uevents; drop truncated datagrams.
+            if (addrs_[i].nl_pid != 0 || (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+                continue;
+            }
+            parse_uevent(static_cast<const char*>(iov_[i].iov_base), msgs_[i].msg_len, views_[count++]);
+        }
+        return count;
+    }
+
+    const UeventView* events() const { return views_.data(); }
+    size_t capacity() const { return msgs_.size(); }
+    // Datagrams taken off the socket by the last receive(), parsed or not.
+    size_t last_received() const { return received_; }
+
+private:
+    std::vector<char> buffers_;
+    std::vector<struct iovec> iov_;
+    std::vector<struct sockaddr_nl> addrs_;
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<UeventView> views_;
+    size_t received_ = 0;
+};
+
+inline void set_receive_buffer_size(int sock_fd, int size) {
+    if (size <= 0) {
+        return;
+    }
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0 &&
+        setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0) {
+        std::cerr << "Failed to set socket receive buffer size" << std::endl;
+    }
+}
+
+// Creates a non-blocking socket bound to the kernel uevent multicast group.
+inline int open_uevent_socket(const UeventMonitorOptions& options) {
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (sock < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return -1;
+    }
+
+    set_receive_buffer_size(sock, options.receive_buffer_size);
+
+    // Attach before bind so no unfiltered event is ever queued.
+    if (!options.filter.empty() && !attach_uevent_filter(sock, options.filter)) {
+        std::cerr << "Continuing without kernel-side uevent filtering" << std::endl;
+    }
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_pid = 0; // Let the kernel assign a unique port id
+    addr.nl_groups = 1; // Listen to the kernel event group
+
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "Failed to bind socket" << std::endl;
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+// Drains the socket after an edge-triggered wakeup, handing each recvmmsg
+// batch to the callback. Returns false on an unrecoverable socket error.
+inline bool drain_device_events(int sock_fd, UeventBatch& batch, const UeventBatchCallback& callback,
+                                const UeventMonitorOptions& options) {
+    while (true) {
+        int count = batch.receive(sock_fd);
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                std::cerr << "Uevent socket overflow, events were dropped" << std::endl;
+                if (options.overflow_callback) {
+                    options.overflow_callback();
+                }
+                continue;
+            }
+            std::cerr << "Failed to receive message: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        if (count > 0) {
+            callback(batch.events(), count);
+        }
+        // A short batch means the queue is empty; the next datagram raises a new
+        // edge. Judge by datagrams read, since skipped ones shrink count.
+        if (batch.last_received() < batch.capacity()) {
+            return true;
+        }
+    }
+}
+
+// Waits on an edge-triggered fd and calls drain() on every wakeup, plus once
+// up front since data queued before registration raises no edge. Stops when
+// drain() reports an unrecoverable error. With a positive interval_ms, tick()
+// also runs every interval_ms whether or not events arrive.
+inline void run_edge_triggered_loop(int fd, const std::function<bool()>& drain, int interval_ms = -1,
+                                    const std::function<void()>& tick = nullptr) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        std::cerr << "Failed to create epoll instance" << std::endl;
+        return;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        std::cerr << "Failed to add socket to epoll" << std::endl;
+        close(epoll_fd);
+        return;
+    }
+
+    bool running = drain();
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point next_tick = Clock::now() + std::chrono::milliseconds(interval_ms);
+
+    struct epoll_event events[10];
+    while (running) {
+        int timeout = -1;
+        if (interval_ms > 0 && tick) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - Clock::now()).count();
+            if (left <= 0) {
+                tick();
+                next_tick = Clock::now() + std::chrono::milliseconds(interval_ms);
+                left = interval_ms;
+            }
+            timeout = static_cast<int>(left);
+        }
+
+        int num_events = epoll_wait(epoll_fd, events, 10, timeout);
+        if (num_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error in epoll_wait" << std::endl;
+            break;
+        }
+
+        // Handle each event
+        for (int i = 0; i < num_events && running; i++) {
+            if (events[i].data.fd == fd) {
+                running = drain();
+            }
+        }
+    }
+
+    close(epoll_fd);
+}
+
+inline void monitor_device_events(const UeventBatchCallback& callback, const UeventMonitorOptions& options = UeventMonitorOptions()) {
+    int sock = open_uevent_socket(options);
+    if (sock < 0) {
+        return;
+    }
+
+    UeventBatch batch(options.batch_size ? options.batch_size : 1);
+    run_edge_triggered_loop(sock, [&]() {
+        return drain_device_events(sock, batch, callback, options);
+    });
+
+    close(sock);
+}
+
+inline void monitor_device_events(const UeventCallback& callback, const UeventMonitorOptions& options = UeventMonitorOptions()) {
+    monitor_device_events(UeventBatchCallback([&callback](const UeventView* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            callback(events[i]);
+        }
+    }), options);
+}
+
+inline void monitor_device_events(const EventCallback& callback, const UeventMonitorOptions& options = UeventMonitorOptions()) {
+    monitor_device_events(UeventCallback([&callback](const UeventView& event) {
+        callback(parse_event_data(event));
+    }), options);
+}
+
+#endif // UEVENT_MONITOR_H
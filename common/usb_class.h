@@ -0,0 +1,170 @@
+#ifndef USB_CLASS_H
+#define USB_CLASS_H
+
+#include <cstdint>
+#include <string_view>
+
+// USB-IF class codes, https://www.usb.org/defined-class-codes
+
+struct UsbClassTable {
+    const char* names[256];
+};
+
+constexpr UsbClassTable make_usb_class_table() {
+    UsbClassTable table{};
+    for (auto& name : table.names) {
+        name = "Unknown USB class";
+    }
+    table.names[0x00] = "Device: Use class information in the Interface Descriptors";
+    table.names[0x01] = "Interface: Audio";
+    table.names[0x02] = "Both: Communications and CDC Control";
+    table.names[0x03] = "Interface: HID (Human Interface Device)";
+    table.names[0x05] = "Interface: Physical";
+    table.names[0x06] = "Interface: Image";
+    table.names[0x07] = "Interface: Printer";
+    table.names[0x08] = "Interface: Mass Storage";
+    table.names[0x09] = "Device: Hub";
+    table.names[0x0A] = "Interface: CDC-Data";
+    table.names[0x0B] = "Interface: Smart Card";
+    table.names[0x0D] = "Interface: Content Security";
+    table.names[0x0E] = "Interface: Video";
+    table.names[0x0F] = "Interface: Personal Healthcare";
+    table.names[0x10] = "Interface: Audio/Video Devices";
+    table.names[0x11] = "Device: Billboard Device Class";
+    table.names[0x12] = "Interface: USB Type-C Bridge Class";
+    table.names[0x13] = "Interface: USB Bulk Display Protocol Device Class";
+    table.names[0x14] = "Interface: MCTP over USB Protocol Endpoint Device Class";
+    table.names[0x3C] = "Interface: I3C Device Class";
+    table.names[0xDC] = "Both: Diagnostic Device";
+    table.names[0xE0] = "Interface: Wireless Controller";
+    table.names[0xEF] = "Both: Miscellaneous";
+    table.names[0xFE] = "Interface: Application Specific";
+    table.names[0xFF] = "Both: Vendor Specific";
+    return table;
+}
+
+inline constexpr UsbClassTable kUsbClassTable = make_usb_class_table();
+
+constexpr const char* usb_class_description(uint8_t class_code) {
+    return kUsbClassTable.names[class_code];
+}
+
+constexpr int hex_digit_value(char c) {
+    return c >= '0' && c <= '9' ? c - '0'
+         : c >= 'a' && c <= 'f' ? c - 'a' + 10
+         : c >= 'A' && c <= 'F' ? c - 'A' + 10
+         : -1;
+}
+
+// Parses a one- or two-digit hex byte ("2", "02", "0a", "0A"); -1 if invalid.
+constexpr int parse_usb_hex_byte(std::string_view text) {
+    if (text.empty() || text.size() > 2) {
+        return -1;
+    }
+    int value = 0;
+    for (char c : text) {
+        int digit = hex_digit_value(c);
+        if (digit < 0) {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// Accepts the bDeviceClass/bInterfaceClass sysattr text.
+constexpr const char* get_usb_class_description(std::string_view class_code) {
+    int value = parse_usb_hex_byte(class_code);
+    return value < 0 ? "Unknown USB class" : usb_class_description(static_cast<uint8_t>(value));
+}
+
+struct UsbInterfaceType {
+    uint8_t interface_class;
+    uint8_t subclass;
+    int16_t protocol; // -1 matches any protocol
+    const char* description;
+};
+
+// Subclass/protocol pairs worth naming. Entries for a given class and
+// subclass are ordered specific protocol first, wildcard last.
+inline constexpr UsbInterfaceType kUsbInterfaceTypes[] = {
+    {0x01, 0x01, -1, "Audio Control"},
+    {0x01, 0x02, -1, "Audio Streaming"},
+    {0x01, 0x03, -1, "MIDI Streaming"},
+    {0x02, 0x02, 0x01, "CDC Abstract Control Model (AT commands V.250)"},
+    {0x02, 0x02, 0xFF, "CDC Abstract Control Model (vendor protocol)"},
+    {0x02, 0x02, -1, "CDC Abstract Control Model"},
+    {0x02, 0x06, -1, "CDC Ethernet Networking Control Model"},
+    {0x02, 0x0A, -1, "CDC Mobile Direct Line Model"},
+    {0x02, 0x0D, -1, "CDC Network Control Model"},
+    {0x02, 0x0E, -1, "CDC Mobile Broadband Interface Model"},
+    {0x03, 0x00, 0x00, "HID"},
+    {0x03, 0x01, 0x01, "HID Boot Interface Keyboard"},
+    {0x03, 0x01, 0x02, "HID Boot Interface Mouse"},
+    {0x03, 0x01, -1, "HID Boot Interface"},
+    {0x06, 0x01, 0x01, "Still Image Capture (PTP)"},
+    {0x07, 0x01, 0x01, "Printer, Unidirectional"},
+    {0x07, 0x01, 0x02, "Printer, Bidirectional"},
+    {0x07, 0x01, 0x03, "Printer, IEEE 1284.4"},
+    {0x08, 0x06, 0x50, "Mass Storage SCSI, Bulk-Only Transport"},
+    {0x08, 0x06, 0x62, "Mass Storage SCSI, USB Attached SCSI"},
+    {0x08, 0x06, -1, "Mass Storage SCSI"},
+    {0x08, 0x02, -1, "Mass Storage ATAPI"},
+    {0x08, 0x04, -1, "Mass Storage UFI (floppy)"},
+    {0x09, 0x00, 0x00, "Hub, Full Speed"},
+    {0x09, 0x00, 0x01, "Hub, Hi-Speed Single TT"},
+    {0x09, 0x00, 0x02, "Hub, Hi-Speed Multiple TT"},
+    {0x09, 0x00, 0x03, "Hub, SuperSpeed"},
+    {0x0A, 0x00, -1, "CDC Data"},
+    {0x0E, 0x01, -1, "Video Control"},
+    {0x0E, 0x02, -1, "Video Streaming"},
+    {0x0E, 0x03, -1, "Video Interface Collection"},
+    {0xDC, 0x01, 0x01, "USB2 Compliance Device"},
+    {0xE0, 0x01, 0x01, "Bluetooth Programming Interface"},
+    {0xE0, 0x01, 0x03, "RNDIS"},
+    {0xE0, 0x01, 0x04, "Bluetooth AMP Controller"},
+    {0xEF, 0x02, 0x01, "Interface Association Descriptor"},
+    {0xEF, 0x04, 0x01, "RNDIS over Ethernet"},
+    {0xFE, 0x01, 0x01, "Device Firmware Upgrade"},
+    {0xFE, 0x02, 0x00, "IrDA Bridge"},
+    {0xFE, 0x03, 0x00, "USB Test and Measurement"},
+    {0xFE, 0x03, 0x01, "USB Test and Measurement (USB488)"},
+};
+
+// Most specific name for an interface triple, falling back to the class name.
+constexpr const char* usb_interface_description(uint8_t interface_class, uint8_t subclass, uint8_t protocol) {
+    for (const auto& type : kUsbInterfaceTypes) {
+        if (type.interface_class == interface_class && type.subclass == subclass &&
+            (type.protocol < 0 || type.protocol == protocol)) {
+            return type.description;
+        }
+    }
+    return usb_class_description(interface_class);
+}
+
+struct UsbInterfaceClass {
+    uint8_t interface_class;
+    uint8_t subclass;
+    uint8_t protocol;
+};
+
+// Walks udev's ID_USB_INTERFACES (":ccsspp:ccsspp:") without allocating.
+// Stops at the first malformed entry.
+template <typename Fn>
+constexpr void for_each_usb_interface(std::string_view interfaces, Fn fn) {
+    for (size_t pos = 0; pos + 7 <= interfaces.size() && interfaces[pos] == ':'; pos += 7) {
+        int interface_class = parse_usb_hex_byte(interfaces.substr(pos + 1, 2));
+        int subclass = parse_usb_hex_byte(interfaces.substr(pos + 3, 2));
+        int protocol = parse_usb_hex_byte(interfaces.substr(pos + 5, 2));
+        if (interface_class < 0 || subclass < 0 || protocol < 0) {
+            return;
+        }
+        fn(UsbInterfaceClass{static_cast<uint8_t>(interface_class), static_cast<uint8_t>(subclass),
+                             static_cast<uint8_t>(protocol)});
+    }
+}
+
+static_assert(parse_usb_hex_byte("0a") == 0x0A && parse_usb_hex_byte("FF") == 0xFF, "hex parsing");
+static_assert(usb_interface_description(0x02, 0x02, 0x01)[0] == 'C', "interface lookup");
+
+#endif // USB_CLASS_H
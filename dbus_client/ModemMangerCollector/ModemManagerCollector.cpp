@@ -1,36 +1,60 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
 #include <dbus/dbus.h>
 
+#include "../common/dbus_async.h"
+#include "../common/introspection_xml.h"
+#include "../common/string_interner.h"
+
+// Names, signatures and flags repeat across every object and are interned;
+// only property values are stored per instance.
+struct Annotation {
+    InternedString name;
+    InternedString value;
+};
+
 struct Method {
-    std::string name;
-    std::string signature;
-    std::string result;
+    InternedString name;
+    InternedString signature; // concatenated in-arg types, "-" if none
+    InternedString result;    // concatenated out-arg types, "-" if none
+    std::vector<Annotation> annotations;
 };
 
 struct Signal {
-    std::string name;
-    std::string signature;
+    InternedString name;
+    InternedString signature;
+    std::vector<Annotation> annotations;
 };
 
 struct Property {
-    std::string name;
-    std::string type;
+    InternedString name;
+    InternedString type;
     std::string value;
-    std::string flags;
+    InternedString flags; // access: read, write or readwrite
+    std::vector<Annotation> annotations;
 };
 
 struct Interface {
-    std::string name;
+    InternedString name;
     std::vector<Method> methods;
     std::vector<Signal> signals;
     std::vector<Property> properties;
+    std::vector<Annotation> annotations;
 };
 
+// One object exported under the ObjectManager root: a modem, bearer, SIM...
 struct Device {
     std::string path;
-    // Add additional device information as needed
+    // interface -> property -> formatted value
+    std::map<InternedString, std::map<InternedString, std::string>> interfaces;
 };
 
 struct IntrospectionData {
@@ -38,6 +62,448 @@ struct IntrospectionData {
     std::vector<Device> devices;
 };
 
+InternedString joinArgTypes(const IntrospectionDocument& doc, const IntrospectMember& member, bool out) {
+    std::string types;
+    for (uint32_t i = member.first_arg; i < member.first_arg + member.arg_count; ++i) {
+        if (doc.args[i].out == out) {
+            types += doc.args[i].type.str();
+        }
+    }
+    return InternedString(types.empty() ? "-" : types);
+}
+
+IntrospectionData buildIntrospectionData(const IntrospectionDocument& doc) {
+    IntrospectionData data;
+    data.interfaces.reserve(doc.interfaces.size());
+    // Where each document member landed, for attaching its annotations.
+    std::vector<std::pair<size_t, size_t>> memberSlots(doc.members.size());
+
+    for (const auto& docIface : doc.interfaces) {
+        Interface iface;
+        iface.name = docIface.name;
+        for (uint32_t i = docIface.first_member; i < docIface.first_member + docIface.member_count; ++i) {
+            const IntrospectMember& member = doc.members[i];
+            switch (member.kind) {
+            case MemberKind::Method:
+                memberSlots[i] = {0, iface.methods.size()};
+                iface.methods.push_back(Method{member.name, joinArgTypes(doc, member, false), joinArgTypes(doc, member, true), {}});
+                break;
+            case MemberKind::Signal:
+                memberSlots[i] = {1, iface.signals.size()};
+                iface.signals.push_back(Signal{member.name, joinArgTypes(doc, member, true), {}});
+                break;
+            case MemberKind::Property:
+                memberSlots[i] = {2, iface.properties.size()};
+                iface.properties.push_back(Property{member.name, member.type, "", member.access, {}});
+                break;
+            }
+        }
+        data.interfaces.push_back(std::move(iface));
+    }
+
+    for (const auto& docAnnotation : doc.annotations) {
+        Interface& iface = data.interfaces[docAnnotation.interface_index];
+        Annotation annotation{docAnnotation.name, docAnnotation.value};
+        if (docAnnotation.member_index < 0) {
+            iface.annotations.push_back(annotation);
+            continue;
+        }
+        auto [kind, index] = memberSlots[docAnnotation.member_index];
+        if (kind == 0) iface.methods[index].annotations.push_back(annotation);
+        else if (kind == 1) iface.signals[index].annotations.push_back(annotation);
+        else iface.properties[index].annotations.push_back(annotation);
+    }
+
+    return data;
+}
+
+// Introspection results keyed by (bus name, object path, unique owner). A
+// service that restarts gets a new unique name, so its old entries can never
+// match again; NameOwnerChanged drops them eagerly as well. Only owner
+// changes of the watched bus name are subscribed to.
+class IntrospectionCache {
+public:
+    IntrospectionCache(DBusConnection* connection, const std::string& busName)
+        : connection_(connection),
+          match_rule_("type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+                      "member='NameOwnerChanged',arg0='" + busName + "'") {
+        dbus_bus_add_match(connection_, match_rule_.c_str(), nullptr);
+        dbus_connection_add_filter(connection_, nameOwnerChanged, this, nullptr);
+    }
+
+    ~IntrospectionCache() {
+        dbus_connection_remove_filter(connection_, nameOwnerChanged, this);
+        dbus_bus_remove_match(connection_, match_rule_.c_str(), nullptr);
+    }
+
+    IntrospectionCache(const IntrospectionCache&) = delete;
+    IntrospectionCache& operator=(const IntrospectionCache&) = delete;
+
+    const IntrospectionData* find(const std::string& busName, const std::string& path, const std::string& owner) const {
+        auto it = entries_.find(std::make_tuple(busName, path, owner));
+        return it == entries_.end() ? nullptr : &it->second;
+    }
+
+    const IntrospectionData& store(const std::string& busName, const std::string& path, const std::string& owner,
+                                   IntrospectionData data) {
+        return entries_[std::make_tuple(busName, path, owner)] = std::move(data);
+    }
+
+    // Delivers queued NameOwnerChanged signals without blocking.
+    void poll() {
+        dbus_connection_read_write(connection_, 0);
+        while (dbus_connection_dispatch(connection_) == DBUS_DISPATCH_DATA_REMAINS) {
+        }
+    }
+
+    size_t size() const { return entries_.size(); }
+
+private:
+    using Key = std::tuple<std::string, std::string, std::string>;
+
+    void invalidate(const char* name, const char* oldOwner) {
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            const auto& [busName, path, owner] = it->first;
+            if (busName == name || (oldOwner[0] != '\0' && owner == oldOwner)) {
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static DBusHandlerResult nameOwnerChanged(DBusConnection* connection, DBusMessage* message, void* user_data) {
+        const char* name;
+        const char* oldOwner;
+        const char* newOwner;
+        if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameOwnerChanged") &&
+            dbus_message_get_args(message, nullptr, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &oldOwner,
+                                  DBUS_TYPE_STRING, &newOwner, DBUS_TYPE_INVALID)) {
+            static_cast<IntrospectionCache*>(user_data)->invalidate(name, oldOwner);
+        }
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    DBusConnection* connection_;
+    std::string match_rule_;
+    std::map<Key, IntrospectionData> entries_;
+};
+
+// Renders any D-Bus value as text: arrays as [a, b], dicts as {k: v},
+// structs as (a, b). Variants are unwrapped.
+std::string formatValue(DBusMessageIter* iter) {
+    int type = dbus_message_iter_get_arg_type(iter);
+    switch (type) {
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+    case DBUS_TYPE_SIGNATURE: {
+        const char* value;
+        dbus_message_iter_get_basic(iter, &value);
+        return value;
+    }
+    case DBUS_TYPE_BOOLEAN: {
+        dbus_bool_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return value ? "true" : "false";
+    }
+    case DBUS_TYPE_BYTE: {
+        unsigned char value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_INT16: {
+        dbus_int16_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_UINT16: {
+        dbus_uint16_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_INT32: {
+        dbus_int32_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_UINT32: {
+        dbus_uint32_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_INT64: {
+        dbus_int64_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_UINT64: {
+        dbus_uint64_t value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_DOUBLE: {
+        double value;
+        dbus_message_iter_get_basic(iter, &value);
+        return std::to_string(value);
+    }
+    case DBUS_TYPE_VARIANT: {
+        DBusMessageIter inner;
+        dbus_message_iter_recurse(iter, &inner);
+        return formatValue(&inner);
+    }
+    case DBUS_TYPE_ARRAY:
+    case DBUS_TYPE_STRUCT: {
+        DBusMessageIter inner;
+        dbus_message_iter_recurse(iter, &inner);
+        bool dict = type == DBUS_TYPE_ARRAY && dbus_message_iter_get_arg_type(&inner) == DBUS_TYPE_DICT_ENTRY;
+        std::string text = dict ? "{" : type == DBUS_TYPE_ARRAY ? "[" : "(";
+        bool first = true;
+        while (dbus_message_iter_get_arg_type(&inner) != DBUS_TYPE_INVALID) {
+            if (!first) {
+                text += ", ";
+            }
+            first = false;
+            if (dict) {
+                DBusMessageIter entry;
+                dbus_message_iter_recurse(&inner, &entry);
+                text += formatValue(&entry);
+                dbus_message_iter_next(&entry);
+                text += ": " + formatValue(&entry);
+            } else {
+                text += formatValue(&inner);
+            }
+            dbus_message_iter_next(&inner);
+        }
+        return text + (dict ? "}" : type == DBUS_TYPE_ARRAY ? "]" : ")");
+    }
+    default:
+        return "?";
+    }
+}
+
+// Local mirror of everything exported under an ObjectManager root. One
+// GetManagedObjects call returns every object with all of its properties;
+// after that InterfacesAdded, InterfacesRemoved and PropertiesChanged keep
+// the mirror current, so nothing is queried per object. The match rules are
+// installed before the initial fetch, so no change can fall in between.
+class ManagedObjectModel {
+public:
+    ManagedObjectModel(DBusConnection* connection, const std::string& busName, const std::string& rootPath)
+        : connection_(connection), bus_name_(busName), root_path_(rootPath) {
+        for (const std::string& rule : matchRules()) {
+            dbus_bus_add_match(connection_, rule.c_str(), nullptr);
+        }
+        dbus_connection_add_filter(connection_, filter, this, nullptr);
+    }
+
+    ~ManagedObjectModel() {
+        dbus_connection_remove_filter(connection_, filter, this);
+        for (const std::string& rule : matchRules()) {
+            dbus_bus_remove_match(connection_, rule.c_str(), nullptr);
+        }
+    }
+
+    ManagedObjectModel(const ManagedObjectModel&) = delete;
+    ManagedObjectModel& operator=(const ManagedObjectModel&) = delete;
+
+    // Replaces the mirror with a fresh GetManagedObjects snapshot.
+    void load() {
+        DBusMessage* msg = dbus_message_new_method_call(bus_name_.c_str(), root_path_.c_str(),
+                                                        "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
+        if (!msg) {
+            throw std::runtime_error("Failed to create a new D-Bus message");
+        }
+
+        DBusError error;
+        dbus_error_init(&error);
+        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection_, msg, DBUS_CALL_TIMEOUT_MS, &error);
+        dbus_message_unref(msg);
+        if (!reply) {
+            std::string message = std::string("GetManagedObjects failed: ") + (error.message ? error.message : "no reply");
+            dbus_error_free(&error);
+            throw std::runtime_error(message);
+        }
+
+        DBusMessageIter args;
+        if (!dbus_message_has_signature(reply, "a{oa{sa{sv}}}") || !dbus_message_iter_init(reply, &args)) {
+            dbus_message_unref(reply);
+            throw std::runtime_error("Unexpected GetManagedObjects reply signature");
+        }
+
+        devices_.clear();
+        owner_ = dbus_message_get_sender(reply);
+        DBusMessageIter objects;
+        dbus_message_iter_recurse(&args, &objects);
+        while (dbus_message_iter_get_arg_type(&objects) == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter entry;
+            dbus_message_iter_recurse(&objects, &entry);
+            const char* path;
+            dbus_message_iter_get_basic(&entry, &path);
+            dbus_message_iter_next(&entry);
+            addInterfaces(path, &entry);
+            dbus_message_iter_next(&objects);
+        }
+        dbus_message_unref(reply);
+        stale_ = false;
+    }
+
+    // True until the first load and again after the service restarts.
+    bool stale() const { return stale_; }
+    const std::map<std::string, Device>& devices() const { return devices_; }
+
+private:
+    std::vector<std::string> matchRules() const {
+        std::string base = "type='signal',sender='" + bus_name_ + "',";
+        return {
+            base + "interface='org.freedesktop.DBus.ObjectManager',path='" + root_path_ + "'",
+            base + "interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',path_namespace='" + root_path_ + "'",
+            "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='" +
+                bus_name_ + "'",
+        };
+    }
+
+    // iter points at an a{sa{sv}}: interface name -> properties.
+    void addInterfaces(const char* path, DBusMessageIter* iter) {
+        Device& device = devices_[path];
+        device.path = path;
+        DBusMessageIter ifaces;
+        dbus_message_iter_recurse(iter, &ifaces);
+        while (dbus_message_iter_get_arg_type(&ifaces) == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter entry;
+            dbus_message_iter_recurse(&ifaces, &entry);
+            const char* name;
+            dbus_message_iter_get_basic(&entry, &name);
+            dbus_message_iter_next(&entry);
+            updateProperties(device.interfaces[InternedString(name)], &entry);
+            dbus_message_iter_next(&ifaces);
+        }
+    }
+
+    // iter points at an a{sv}.
+    static void updateProperties(std::map<InternedString, std::string>& properties, DBusMessageIter* iter) {
+        DBusMessageIter dict;
+        dbus_message_iter_recurse(iter, &dict);
+        while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter entry;
+            dbus_message_iter_recurse(&dict, &entry);
+            const char* name;
+            dbus_message_iter_get_basic(&entry, &name);
+            dbus_message_iter_next(&entry);
+            properties[InternedString(name)] = formatValue(&entry);
+            dbus_message_iter_next(&dict);
+        }
+    }
+
+    void interfacesAdded(DBusMessage* message) {
+        DBusMessageIter args;
+        if (!dbus_message_has_signature(message, "oa{sa{sv}}") || !dbus_message_iter_init(message, &args)) {
+            return;
+        }
+        const char* path;
+        dbus_message_iter_get_basic(&args, &path);
+        dbus_message_iter_next(&args);
+        bool known = devices_.count(path) != 0;
+        addInterfaces(path, &args);
+        std::cout << (known ? "Updated: " : "Added: ") << path << "\n";
+    }
+
+    void interfacesRemoved(DBusMessage* message) {
+        DBusMessageIter args;
+        if (!dbus_message_has_signature(message, "oas") || !dbus_message_iter_init(message, &args)) {
+            return;
+        }
+        const char* path;
+        dbus_message_iter_get_basic(&args, &path);
+        auto it = devices_.find(path);
+        if (it == devices_.end()) {
+            return;
+        }
+        dbus_message_iter_next(&args);
+        DBusMessageIter names;
+        dbus_message_iter_recurse(&args, &names);
+        while (dbus_message_iter_get_arg_type(&names) == DBUS_TYPE_STRING) {
+            const char* name;
+            dbus_message_iter_get_basic(&names, &name);
+            it->second.interfaces.erase(InternedString(name));
+            dbus_message_iter_next(&names);
+        }
+        // An object is gone once its last interface is.
+        if (it->second.interfaces.empty()) {
+            devices_.erase(it);
+            std::cout << "Removed: " << path << "\n";
+        } else {
+            std::cout << "Updated: " << path << "\n";
+        }
+    }
+
+    void propertiesChanged(DBusMessage* message) {
+        auto it = devices_.find(dbus_message_get_path(message));
+        DBusMessageIter args;
+        if (it == devices_.end() || !dbus_message_has_signature(message, "sa{sv}as") ||
+            !dbus_message_iter_init(message, &args)) {
+            return;
+        }
+        const char* iface;
+        dbus_message_iter_get_basic(&args, &iface);
+        dbus_message_iter_next(&args);
+        auto& properties = it->second.interfaces[InternedString(iface)];
+        updateProperties(properties, &args);
+        // ModemManager always sends values; invalidated names just lose theirs.
+        dbus_message_iter_next(&args);
+        DBusMessageIter names;
+        dbus_message_iter_recurse(&args, &names);
+        while (dbus_message_iter_get_arg_type(&names) == DBUS_TYPE_STRING) {
+            const char* name;
+            dbus_message_iter_get_basic(&names, &name);
+            properties.erase(InternedString(name));
+            dbus_message_iter_next(&names);
+        }
+    }
+
+    static DBusHandlerResult filter(DBusConnection* connection, DBusMessage* message, void* user_data) {
+        ManagedObjectModel* model = static_cast<ManagedObjectModel*>(user_data);
+        if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL) {
+            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        }
+
+        if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameOwnerChanged")) {
+            const char* name;
+            const char* oldOwner;
+            const char* newOwner;
+            if (dbus_message_get_args(message, nullptr, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &oldOwner,
+                                      DBUS_TYPE_STRING, &newOwner, DBUS_TYPE_INVALID) &&
+                model->bus_name_ == name) {
+                // A new owner starts with its own object tree; refetch it.
+                model->devices_.clear();
+                model->owner_.clear();
+                model->stale_ = true;
+            }
+            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        }
+
+        // Ignore stragglers from a previous owner.
+        const char* sender = dbus_message_get_sender(message);
+        if (model->stale_ || !sender || model->owner_ != sender) {
+            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        }
+        if (dbus_message_is_signal(message, "org.freedesktop.DBus.ObjectManager", "InterfacesAdded")) {
+            model->interfacesAdded(message);
+        } else if (dbus_message_is_signal(message, "org.freedesktop.DBus.ObjectManager", "InterfacesRemoved")) {
+            model->interfacesRemoved(message);
+        } else if (dbus_message_is_signal(message, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged")) {
+            model->propertiesChanged(message);
+        }
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    DBusConnection* connection_;
+    std::string bus_name_;
+    std::string root_path_;
+    std::string owner_;
+    bool stale_ = true;
+    std::map<std::string, Device> devices_;
+};
+
 class DBusIntrospector {
 public:
     DBusIntrospector(const std::string& bus_name, const std::string& object_path)
@@ -46,132 +512,189 @@ public:
         if (!connection) {
             throw std::runtime_error("Failed to connect to the D-Bus system bus");
         }
+        cache = std::make_unique<IntrospectionCache>(connection, bus_name);
+        objects = std::make_unique<ManagedObjectModel>(connection, bus_name, object_path);
     }
 
     ~DBusIntrospector() {
+        objects.reset();
+        cache.reset();
         if (connection) {
             dbus_connection_unref(connection);
         }
     }
 
-    IntrospectionData introspect() {
-        IntrospectionData data;
+    DBusIntrospector(const DBusIntrospector&) = delete;
+    DBusIntrospector& operator=(const DBusIntrospector&) = delete;
 
-        // Introspect for interfaces
-        DBusMessage* msg = dbus_message_new_method_call(bus_name.c_str(), object_path.c_str(), "org.freedesktop.DBus.Introspectable", "Introspect");
+    // Unique connection name currently owning bus_name.
+    std::string get_name_owner() {
+        DBusMessage* msg = dbus_message_new_method_call("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                        "org.freedesktop.DBus", "GetNameOwner");
         if (!msg) {
             throw std::runtime_error("Failed to create a new D-Bus message");
         }
+        const char* name = bus_name.c_str();
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
 
-        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, msg, -1, nullptr);
+        DBusError error;
+        dbus_error_init(&error);
+        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, msg, DBUS_CALL_TIMEOUT_MS, &error);
         dbus_message_unref(msg);
-
         if (!reply) {
-            throw std::runtime_error("Failed to get a reply from the D-Bus message");
-        }
-
-        const char* xml_data;
-        if (dbus_message_get_args(reply, nullptr, DBUS_TYPE_STRING, &xml_data, DBUS_TYPE_INVALID)) {
-            // Parse the XML data here and populate 'data'
-            // For simplicity, manually populating data
-            Interface iface;
-            iface.name = "org.freedesktop.ModemManager1";
-
-            // Add Methods
-            iface.methods.push_back(Method{"InhibitDevice", "sb", "-"});
-            iface.methods.push_back(Method{"ReportKernelEvent", "a{sv}", "-"});
-            iface.methods.push_back(Method{"ScanDevices", "-", "-"});
-            iface.methods.push_back(Method{"SetLogging", "s", "-"});
-
-            // Add Signals
-            iface.signals.push_back(Signal{"InterfacesAdded", "oa{sa{sv}}"});
-            iface.signals.push_back(Signal{"InterfacesRemoved", "oas"});
-
-            // Add Properties
-            iface.properties.push_back(Property{"Version", "s", "\"1.20.0\"", "emits-change"});
-
-            // Add this interface to introspection data
-            data.interfaces.push_back(iface);
+            std::string message = std::string("Failed to resolve the owner of ") + bus_name + ": " +
+                                  (error.message ? error.message : "no reply");
+            dbus_error_free(&error);
+            throw std::runtime_error(message);
         }
 
+        const char* owner = "";
+        dbus_message_get_args(reply, nullptr, DBUS_TYPE_STRING, &owner, DBUS_TYPE_INVALID);
+        std::string result = owner;
         dbus_message_unref(reply);
-
-        return data;
+        return result;
     }
 
-    std::vector<Device> scan_devices() {
-        std::vector<Device> devices;
+    bool last_introspect_cached() const { return last_cached; }
 
-        // Call ScanDevices method
-        DBusMessage* msg = dbus_message_new_method_call(bus_name.c_str(), object_path.c_str(), "org.freedesktop.ModemManager1", "ScanDevices");
+    // Parses the object's introspection XML. Results are reused for as long
+    // as the same unique connection owns bus_name.
+    IntrospectionData introspect() {
+        cache->poll();
+        std::string owner = get_name_owner();
+        if (const IntrospectionData* cached = cache->find(bus_name, object_path, owner)) {
+            last_cached = true;
+            return *cached;
+        }
+        last_cached = false;
+
+        DBusMessage* msg = dbus_message_new_method_call(bus_name.c_str(), object_path.c_str(), "org.freedesktop.DBus.Introspectable", "Introspect");
         if (!msg) {
             throw std::runtime_error("Failed to create a new D-Bus message");
         }
 
-        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, msg, -1, nullptr);
+        DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, msg, DBUS_CALL_TIMEOUT_MS, nullptr);
         dbus_message_unref(msg);
 
         if (!reply) {
             throw std::runtime_error("Failed to get a reply from the D-Bus message");
         }
 
-        // Parse the reply to extract device information
-        DBusMessageIter args;
-        if (dbus_message_iter_init(reply, &args) && dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
-            DBusMessageIter array_iter;
-            dbus_message_iter_recurse(&args, &array_iter);
+        const char* xml_data;
+        if (!dbus_message_get_args(reply, nullptr, DBUS_TYPE_STRING, &xml_data, DBUS_TYPE_INVALID)) {
+            dbus_message_unref(reply);
+            throw std::runtime_error("Failed to read the introspection XML");
+        }
+        bool parsed = parse_introspection_xml(xml_data, doc);
+        dbus_message_unref(reply);
+        if (!parsed) {
+            throw std::runtime_error("Failed to parse the introspection XML");
+        }
 
-            while (dbus_message_iter_get_arg_type(&array_iter) == DBUS_TYPE_OBJECT_PATH) {
-                const char* path;
-                dbus_message_iter_get_basic(&array_iter, &path);
+        return cache->store(bus_name, object_path, owner, buildIntrospectionData(doc));
+    }
 
-                Device device;
-                device.path = path;
-                devices.push_back(device);
+    // Every object under object_path. The first call, and the first after
+    // the service restarts, fetches them all; later calls only apply the
+    // change signals that arrived since.
+    const std::map<std::string, Device>& managed_objects() {
+        cache->poll();
+        if (objects->stale()) {
+            objects->load();
+        }
+        return objects->devices();
+    }
 
-                dbus_message_iter_next(&array_iter);
+    // Applies change signals as they arrive for up to seconds.
+    void wait_for_changes(int seconds) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while (true) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0 || !dbus_connection_read_write_dispatch(connection, static_cast<int>(left.count()))) {
+                break;
             }
         }
-
-        dbus_message_unref(reply);
-
-        return devices;
     }
 
 private:
     DBusConnection* connection;
     std::string bus_name;
     std::string object_path;
+    std::unique_ptr<IntrospectionCache> cache;
+    std::unique_ptr<ManagedObjectModel> objects;
+    IntrospectionDocument doc;
+    bool last_cached = false;
 };
+void printAnnotations(const std::vector<Annotation>& annotations, const char* indent) {
+    for (const auto& annotation : annotations) {
+        std::cout << indent << "@" << annotation.name << "(\"" << annotation.value << "\")\n";
+    }
+}
+
+void printIntrospectionData(const IntrospectionData& data) {
+    for (const auto& iface : data.interfaces) {
+        std::cout << "Interface: " << iface.name << "\n";
+        printAnnotations(iface.annotations, "  ");
+        for (const auto& method : iface.methods) {
+            std::cout << "  Method: " << method.name << " (Signature: " << method.signature << ", Result: " << method.result << ")\n";
+            printAnnotations(method.annotations, "    ");
+        }
+        for (const auto& signal : iface.signals) {
+            std::cout << "  Signal: " << signal.name << " (Signature: " << signal.signature << ")\n";
+            printAnnotations(signal.annotations, "    ");
+        }
+        for (const auto& property : iface.properties) {
+            std::cout << "  Property: " << property.name << " (Type: " << property.type << ", Value: " << property.value << ", Flags: " << property.flags << ")\n";
+            printAnnotations(property.annotations, "    ");
+        }
+    }
+}
+
+void printDevices(const std::map<std::string, Device>& devices) {
+    std::cout << "Managed Objects:\n";
+    for (const auto& [path, device] : devices) {
+        std::cout << "  " << path << "\n";
+        for (const auto& [iface, properties] : device.interfaces) {
+            std::cout << "    " << iface << "\n";
+            for (const auto& [name, value] : properties) {
+                std::cout << "      " << name << " = " << value << "\n";
+            }
+        }
+    }
+}
+
 int main(int argc, char* argv[]) {
     try {
         std::string bus_name = "org.freedesktop.ModemManager1";
         std::string object_path = "/org/freedesktop/ModemManager1";
+        int count = 1;
+        int interval = 10;
+        for (int i = 1; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "--count") == 0) {
+                count = std::atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--interval") == 0) {
+                interval = std::atoi(argv[i + 1]);
+            }
+        }
 
         DBusIntrospector introspector(bus_name, object_path);
 
-        // Perform introspection
-        IntrospectionData data = introspector.introspect();
-
-        // Print the introspection data
-        for (const auto& iface : data.interfaces) {
-            std::cout << "Interface: " << iface.name << "\n";
-            for (const auto& method : iface.methods) {
-                std::cout << "  Method: " << method.name << " (Signature: " << method.signature << ", Result: " << method.result << ")\n";
-            }
-            for (const auto& signal : iface.signals) {
-                std::cout << "  Signal: " << signal.name << " (Signature: " << signal.signature << ")\n";
+        for (int run = 0; run < count; ++run) {
+            if (run > 0) {
+                introspector.wait_for_changes(interval);
             }
-            for (const auto& property : iface.properties) {
-                std::cout << "  Property: " << property.name << " (Type: " << property.type << ", Value: " << property.value << ", Flags: " << property.flags << ")\n";
+
+            // Perform introspection; unchanged owners are served from the cache
+            IntrospectionData data = introspector.introspect();
+            if (introspector.last_introspect_cached()) {
+                std::cout << "(cached introspection for " << object_path << ")\n";
             }
-        }
 
-        // Scan devices and print their paths
-        std::vector<Device> devices = introspector.scan_devices();
-        std::cout << "Scanned Devices:\n";
-        for (const auto& device : devices) {
-            std::cout << "  Device Path: " << device.path << "\n";
+            // Print the introspection data
+            printIntrospectionData(data);
+
+            // Modems, bearers and SIMs with their properties, kept current by signals
+            printDevices(introspector.managed_objects());
         }
 
     } catch (const std::exception& ex) {
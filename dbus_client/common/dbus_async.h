@@ -0,0 +1,174 @@
+#ifndef DBUS_ASYNC_H
+#define DBUS_ASYNC_H
+
+#include <dbus/dbus.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Default per-call deadline. libdbus' own default is 25 s and -1 means never.
+#define DBUS_CALL_TIMEOUT_MS 5000
+
+struct DBusCallResult {
+    DBusMessage* reply = nullptr; // method return; owned by the queue, valid during the callback
+    std::string error_name;
+    std::string error_message;
+    std::chrono::microseconds latency{0};
+
+    bool ok() const { return reply != nullptr; }
+};
+
+using DBusCallCallback = std::function<void(const DBusCallResult&)>;
+
+// Pipelines method calls over one connection: up to max_in_flight requests
+// are on the wire at once and the rest wait in FIFO order. Each reply, error
+// or timeout is delivered to the call's callback exactly once.
+//
+// Completion runs through dbus_pending_call notify functions, so replies are
+// picked up either by wait() or by whatever loop dispatches the connection
+// (e.g. DBusEventLoop). wait() uses dbus_pending_call_block, which pulls the
+// reply straight off the socket and is therefore safe inside a filter.
+class DBusCallQueue {
+public:
+    explicit DBusCallQueue(DBusConnection* connection, size_t max_in_flight = 32,
+                           int timeout_ms = DBUS_CALL_TIMEOUT_MS)
+        : connection_(connection), max_in_flight_(max_in_flight ? max_in_flight : 1), timeout_ms_(timeout_ms) {}
+
+    ~DBusCallQueue() {
+        for (auto& call : queued_) {
+            dbus_message_unref(call.message);
+        }
+        // Cancelled calls never complete, so their callbacks must not run.
+        for (auto& call : in_flight_) {
+            dbus_pending_call_cancel(call.pending);
+            dbus_pending_call_unref(call.pending);
+        }
+    }
+
+    DBusCallQueue(const DBusCallQueue&) = delete;
+    DBusCallQueue& operator=(const DBusCallQueue&) = delete;
+
+    // Queues a call. Takes its own reference to message. A timeout_ms of 0
+    // uses the queue default.
+    void call(DBusMessage* message, DBusCallCallback callback, int timeout_ms = 0) {
+        dbus_message_ref(message);
+        queued_.push_back({message, std::move(callback), timeout_ms ? timeout_ms : timeout_ms_});
+        pump();
+    }
+
+    // Blocks until every queued call has completed or timed out.
+    void wait() {
+        while (!in_flight_.empty()) {
+            DBusPendingCall* pending = dbus_pending_call_ref(in_flight_.front().pending);
+            dbus_pending_call_block(pending);
+            // Normally the notify function has already run; never spin on a
+            // call libdbus gave up on without completing.
+            if (!dbus_pending_call_get_completed(pending)) {
+                dbus_pending_call_cancel(pending);
+            }
+            complete(pending);
+            dbus_pending_call_unref(pending);
+        }
+    }
+
+    size_t inFlight() const { return in_flight_.size(); }
+    size_t queued() const { return queued_.size(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedCall {
+        DBusMessage* message;
+        DBusCallCallback callback;
+        int timeout_ms;
+    };
+
+    struct InFlightCall {
+        DBusPendingCall* pending;
+        DBusCallCallback callback;
+        Clock::time_point sent;
+    };
+
+    void pump() {
+        while (in_flight_.size() < max_in_flight_ && !queued_.empty()) {
+            QueuedCall call = std::move(queued_.front());
+            queued_.pop_front();
+
+            DBusPendingCall* pending = nullptr;
+            Clock::time_point sent = Clock::now();
+            bool sent_ok = dbus_connection_send_with_reply(connection_, call.message, &pending, call.timeout_ms);
+            dbus_message_unref(call.message);
+            if (!sent_ok || !pending) {
+                // Out of memory or the connection is already closed.
+                DBusCallResult result;
+                result.error_name = DBUS_ERROR_DISCONNECTED;
+                result.error_message = "Connection is closed";
+                if (call.callback) {
+                    call.callback(result);
+                }
+                continue;
+            }
+
+            in_flight_.push_back({pending, std::move(call.callback), sent});
+            if (!dbus_pending_call_set_notify(pending, onComplete, this, nullptr)) {
+                dbus_pending_call_block(pending);
+            }
+            if (dbus_pending_call_get_completed(pending)) {
+                complete(pending);
+            }
+        }
+    }
+
+    void complete(DBusPendingCall* pending) {
+        auto it = std::find_if(in_flight_.begin(), in_flight_.end(),
+                               [pending](const InFlightCall& call) { return call.pending == pending; });
+        if (it == in_flight_.end()) {
+            return;
+        }
+        InFlightCall call = std::move(*it);
+        in_flight_.erase(it);
+
+        DBusCallResult result;
+        result.latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - call.sent);
+        DBusMessage* reply = dbus_pending_call_steal_reply(pending);
+        dbus_pending_call_unref(pending);
+
+        if (reply && dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+            DBusError error;
+            dbus_error_init(&error);
+            dbus_set_error_from_message(&error, reply);
+            result.error_name = error.name ? error.name : "";
+            result.error_message = error.message ? error.message : "";
+            dbus_error_free(&error);
+        } else if (reply) {
+            result.reply = reply;
+        } else {
+            result.error_name = DBUS_ERROR_NO_REPLY;
+            result.error_message = "No reply";
+        }
+
+        if (call.callback) {
+            call.callback(result);
+        }
+        if (reply) {
+            dbus_message_unref(reply);
+        }
+        pump();
+    }
+
+    static void onComplete(DBusPendingCall* pending, void* data) {
+        static_cast<DBusCallQueue*>(data)->complete(pending);
+    }
+
+    DBusConnection* connection_;
+    size_t max_in_flight_;
+    int timeout_ms_;
+    std::deque<QueuedCall> queued_;
+    std::vector<InFlightCall> in_flight_;
+};
+
+#endif // DBUS_ASYNC_H
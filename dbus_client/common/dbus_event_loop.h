@@ -0,0 +1,328 @@
+#ifndef DBUS_EVENT_LOOP_H
+#define DBUS_EVENT_LOOP_H
+
+#include <dbus/dbus.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+
+// epoll main loop for a single libdbus connection. libdbus reports the fds and
+// timers it needs through the watch/timeout callbacks; the loop sleeps in
+// epoll_wait until one of them is due, then dispatches queued messages to the
+// connection's filters. quit() and wakeup() may be called from any thread.
+class DBusEventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit DBusEventLoop(DBusConnection* connection)
+        : connection_(connection),
+          epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+          wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (epoll_fd_ >= 0 && wakeup_fd_ >= 0) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = wakeup_fd_;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+        }
+    }
+
+    ~DBusEventLoop() {
+        if (attached_) {
+            dbus_connection_set_watch_functions(connection_, nullptr, nullptr, nullptr, nullptr, nullptr);
+            dbus_connection_set_timeout_functions(connection_, nullptr, nullptr, nullptr, nullptr, nullptr);
+            dbus_connection_set_wakeup_main_function(connection_, nullptr, nullptr, nullptr);
+            dbus_connection_set_dispatch_status_function(connection_, nullptr, nullptr, nullptr);
+        }
+        if (wakeup_fd_ >= 0) {
+            close(wakeup_fd_);
+        }
+        if (epoll_fd_ >= 0) {
+            close(epoll_fd_);
+        }
+    }
+
+    DBusEventLoop(const DBusEventLoop&) = delete;
+    DBusEventLoop& operator=(const DBusEventLoop&) = delete;
+
+    // Hands the connection's fds and timers over to this loop.
+    bool attach() {
+        if (epoll_fd_ < 0 || wakeup_fd_ < 0) {
+            std::cerr << "Failed to create epoll instance" << std::endl;
+            return false;
+        }
+        if (!dbus_connection_set_watch_functions(connection_, addWatch, removeWatch, toggleWatch, this, nullptr) ||
+            !dbus_connection_set_timeout_functions(connection_, addTimeout, removeTimeout, toggleTimeout, this, nullptr)) {
+            std::cerr << "Failed to install D-Bus watch functions" << std::endl;
+            return false;
+        }
+        dbus_connection_set_wakeup_main_function(connection_, wakeupMain, this, nullptr);
+        dbus_connection_set_dispatch_status_function(connection_, dispatchStatusChanged, this, nullptr);
+        attached_ = true;
+        // Messages may already be queued from blocking calls made before attach.
+        dispatch_pending_ = true;
+        return true;
+    }
+
+    // Calls callback once the connection has been quiet for interval, and
+    // again every interval while it stays quiet. A zero interval disables it.
+    void setIdleTimer(std::chrono::milliseconds interval, std::function<void()> callback) {
+        idle_interval_ = interval;
+        idle_callback_ = std::move(callback);
+        idle_deadline_ = Clock::now() + interval;
+    }
+
+    // Runs until quit() is called or the bus connection is lost.
+    void run() {
+        struct epoll_event events[16];
+        running_ = true;
+        while (running_) {
+            dispatch();
+            if (!dbus_connection_get_is_connected(connection_)) {
+                std::cerr << "Disconnected from the bus" << std::endl;
+                break;
+            }
+
+            int num_events = epoll_wait(epoll_fd_, events, 16, nextTimeout());
+            if (num_events < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error in epoll_wait" << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < num_events; ++i) {
+                if (events[i].data.fd == wakeup_fd_) {
+                    uint64_t count;
+                    while (read(wakeup_fd_, &count, sizeof(count)) > 0) {
+                    }
+                } else {
+                    handleWatches(events[i].data.fd, events[i].events);
+                }
+            }
+            runTimeouts();
+        }
+        running_ = false;
+    }
+
+    void quit() {
+        running_ = false;
+        wakeup();
+    }
+
+    void wakeup() {
+        uint64_t one = 1;
+        ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+        (void)written;
+    }
+
+private:
+    struct TimeoutEntry {
+        DBusTimeout* timeout;
+        Clock::time_point deadline;
+    };
+
+    void dispatch() {
+        if (!dispatch_pending_) {
+            return;
+        }
+        dispatch_pending_ = false;
+        while (dbus_connection_dispatch(connection_) == DBUS_DISPATCH_DATA_REMAINS) {
+        }
+        if (idle_interval_.count() > 0) {
+            idle_deadline_ = Clock::now() + idle_interval_;
+        }
+    }
+
+    // Milliseconds until the nearest libdbus timeout or idle deadline, -1 if none.
+    int nextTimeout() const {
+        if (dispatch_pending_) {
+            return 0;
+        }
+        bool any = false;
+        Clock::time_point nearest;
+        for (const auto& entry : timeouts_) {
+            if (dbus_timeout_get_enabled(entry.timeout) && (!any || entry.deadline < nearest)) {
+                nearest = entry.deadline;
+                any = true;
+            }
+        }
+        if (idle_interval_.count() > 0 && (!any || idle_deadline_ < nearest)) {
+            nearest = idle_deadline_;
+            any = true;
+        }
+        if (!any) {
+            return -1;
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nearest - Clock::now()).count();
+        // Round up so we never wake a millisecond early and spin.
+        return wait <= 0 ? 0 : static_cast<int>(wait) + 1;
+    }
+
+    void runTimeouts() {
+        Clock::time_point now = Clock::now();
+        // dbus_timeout_handle may add or remove timeouts, so work on a copy.
+        std::vector<DBusTimeout*> due;
+        for (auto& entry : timeouts_) {
+            if (dbus_timeout_get_enabled(entry.timeout) && entry.deadline <= now) {
+                entry.deadline = now + std::chrono::milliseconds(dbus_timeout_get_interval(entry.timeout));
+                due.push_back(entry.timeout);
+            }
+        }
+        for (DBusTimeout* timeout : due) {
+            if (findTimeout(timeout) != timeouts_.end()) {
+                dbus_timeout_handle(timeout);
+            }
+        }
+
+        if (idle_interval_.count() > 0 && idle_deadline_ <= now) {
+            idle_deadline_ = now + idle_interval_;
+            if (idle_callback_) {
+                idle_callback_();
+            }
+        }
+    }
+
+    void handleWatches(int fd, uint32_t epoll_events) {
+        unsigned int flags = 0;
+        if (epoll_events & EPOLLIN) flags |= DBUS_WATCH_READABLE;
+        if (epoll_events & EPOLLOUT) flags |= DBUS_WATCH_WRITABLE;
+        if (epoll_events & EPOLLERR) flags |= DBUS_WATCH_ERROR;
+        if (epoll_events & EPOLLHUP) flags |= DBUS_WATCH_HANGUP;
+
+        // Handling a watch can remove watches on the same fd.
+        std::vector<DBusWatch*> watches = watches_[fd];
+        for (DBusWatch* watch : watches) {
+            auto& current = watches_[fd];
+            if (std::find(current.begin(), current.end(), watch) == current.end() || !dbus_watch_get_enabled(watch)) {
+                continue;
+            }
+            unsigned int wanted = dbus_watch_get_flags(watch) | DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP;
+            if (flags & wanted) {
+                dbus_watch_handle(watch, flags & wanted);
+            }
+        }
+    }
+
+    // libdbus keeps separate read and write watches on the same socket, so
+    // the epoll registration is the union of every enabled watch on that fd.
+    void updateFd(int fd) {
+        uint32_t mask = 0;
+        auto it = watches_.find(fd);
+        if (it != watches_.end()) {
+            for (DBusWatch* watch : it->second) {
+                if (!dbus_watch_get_enabled(watch)) {
+                    continue;
+                }
+                unsigned int flags = dbus_watch_get_flags(watch);
+                if (flags & DBUS_WATCH_READABLE) mask |= EPOLLIN;
+                if (flags & DBUS_WATCH_WRITABLE) mask |= EPOLLOUT;
+            }
+        }
+
+        // Drop the registration while every watch is disabled; epoll would
+        // otherwise keep reporting HUP on a closed socket.
+        bool registered = registered_.count(fd) != 0;
+        if (mask == 0) {
+            if (registered) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+                registered_.erase(fd);
+            }
+            if (it != watches_.end() && it->second.empty()) {
+                watches_.erase(it);
+            }
+            return;
+        }
+
+        struct epoll_event event = {};
+        event.events = mask;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) == 0) {
+            registered_.insert(fd);
+        }
+    }
+
+    std::vector<TimeoutEntry>::iterator findTimeout(DBusTimeout* timeout) {
+        return std::find_if(timeouts_.begin(), timeouts_.end(),
+                            [timeout](const TimeoutEntry& entry) { return entry.timeout == timeout; });
+    }
+
+    static dbus_bool_t addWatch(DBusWatch* watch, void* data) {
+        DBusEventLoop* loop = static_cast<DBusEventLoop*>(data);
+        int fd = dbus_watch_get_unix_fd(watch);
+        loop->watches_[fd].push_back(watch);
+        loop->updateFd(fd);
+        return TRUE;
+    }
+
+    static void removeWatch(DBusWatch* watch, void* data) {
+        DBusEventLoop* loop = static_cast<DBusEventLoop*>(data);
+        int fd = dbus_watch_get_unix_fd(watch);
+        auto& list = loop->watches_[fd];
+        list.erase(std::remove(list.begin(), list.end(), watch), list.end());
+        loop->updateFd(fd);
+    }
+
+    static void toggleWatch(DBusWatch* watch, void* data) {
+        static_cast<DBusEventLoop*>(data)->updateFd(dbus_watch_get_unix_fd(watch));
+    }
+
+    static dbus_bool_t addTimeout(DBusTimeout* timeout, void* data) {
+        DBusEventLoop* loop = static_cast<DBusEventLoop*>(data);
+        loop->timeouts_.push_back({timeout, Clock::now() + std::chrono::milliseconds(dbus_timeout_get_interval(timeout))});
+        return TRUE;
+    }
+
+    static void removeTimeout(DBusTimeout* timeout, void* data) {
+        DBusEventLoop* loop = static_cast<DBusEventLoop*>(data);
+        auto it = loop->findTimeout(timeout);
+        if (it != loop->timeouts_.end()) {
+            loop->timeouts_.erase(it);
+        }
+    }
+
+    static void toggleTimeout(DBusTimeout* timeout, void* data) {
+        DBusEventLoop* loop = static_cast<DBusEventLoop*>(data);
+        auto it = loop->findTimeout(timeout);
+        if (it != loop->timeouts_.end()) {
+            it->deadline = Clock::now() + std::chrono::milliseconds(dbus_timeout_get_interval(timeout));
+        }
+    }
+
+    static void wakeupMain(void* data) {
+        static_cast<DBusEventLoop*>(data)->wakeup();
+    }
+
+    static void dispatchStatusChanged(DBusConnection* connection, DBusDispatchStatus status, void* data) {
+        if (status == DBUS_DISPATCH_DATA_REMAINS) {
+            DBusEventLoop* loop = static_cast<DBusEventLoop*>(data);
+            loop->dispatch_pending_ = true;
+            loop->wakeup();
+        }
+    }
+
+    DBusConnection* connection_;
+    int epoll_fd_;
+    int wakeup_fd_;
+    bool attached_ = false;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> dispatch_pending_{false};
+    std::map<int, std::vector<DBusWatch*>> watches_;
+    std::set<int> registered_;
+    std::vector<TimeoutEntry> timeouts_;
+    std::chrono::milliseconds idle_interval_{0};
+    Clock::time_point idle_deadline_;
+    std::function<void()> idle_callback_;
+};
+
+#endif // DBUS_EVENT_LOOP_H
@@ -0,0 +1,373 @@
+#ifndef INTROSPECTION_XML_H
+#define INTROSPECTION_XML_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "string_arena.h"
+#include "string_interner.h"
+
+// Decodes the five predefined entities and numeric character references.
+// Text without '&' is copied as is.
+inline std::string_view decode_xml_text(std::string_view raw, StringArena& arena) {
+    if (raw.find('&') == std::string_view::npos) {
+        return arena.store(raw);
+    }
+
+    char* out = arena.allocate(raw.size()); // decoding never grows the text
+    size_t length = 0;
+    for (size_t i = 0; i < raw.size();) {
+        if (raw[i] != '&') {
+            out[length++] = raw[i++];
+            continue;
+        }
+        size_t semi = raw.find(';', i);
+        std::string_view entity = semi == std::string_view::npos ? std::string_view() : raw.substr(i + 1, semi - i - 1);
+        char decoded = 0;
+        if (entity == "lt") decoded = '<';
+        else if (entity == "gt") decoded = '>';
+        else if (entity == "amp") decoded = '&';
+        else if (entity == "quot") decoded = '"';
+        else if (entity == "apos") decoded = '\'';
+        else if (entity.size() > 1 && entity[0] == '#') {
+            unsigned long code = 0;
+            bool hex = entity[1] == 'x' || entity[1] == 'X';
+            for (size_t j = hex ? 2 : 1; j < entity.size(); ++j) {
+                char c = entity[j];
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                          : hex && c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : hex && c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (digit < 0) {
+                    code = 0;
+                    break;
+                }
+                code = code * (hex ? 16 : 10) + static_cast<unsigned long>(digit);
+            }
+            // D-Bus names and signatures are ASCII; anything wider is dropped.
+            decoded = code > 0 && code < 0x80 ? static_cast<char>(code) : 0;
+        }
+        if (decoded) {
+            out[length++] = decoded;
+            i = semi + 1;
+        } else {
+            out[length++] = raw[i++];
+        }
+    }
+    return std::string_view(out, length);
+}
+
+// Pull parser for the XML subset used by org.freedesktop.DBus.Introspectable:
+// elements, attributes, comments, processing instructions and DOCTYPE. Names
+// and raw attribute values are views into the input, which must outlive them.
+class XmlPullParser {
+public:
+    enum Event { StartElement, EndElement, End, Error };
+
+    struct Attribute {
+        std::string_view name;
+        std::string_view value; // raw, entities not decoded
+    };
+
+    static constexpr size_t kMaxAttributes = 16;
+
+    explicit XmlPullParser(std::string_view text) : text_(text) {}
+
+    Event next() {
+        if (pending_end_) {
+            pending_end_ = false;
+            attribute_count_ = 0;
+            return EndElement;
+        }
+
+        while (true) {
+            size_t open = text_.find('<', pos_);
+            if (open == std::string_view::npos) {
+                return End;
+            }
+            pos_ = open + 1;
+            if (pos_ >= text_.size()) {
+                return Error;
+            }
+
+            char c = text_[pos_];
+            if (c == '?') {
+                if (!skipPast("?>")) return Error;
+            } else if (c == '!') {
+                if (text_.compare(pos_, 3, "!--") == 0) {
+                    if (!skipPast("-->")) return Error;
+                } else if (!skipDeclaration()) {
+                    return Error;
+                }
+            } else if (c == '/') {
+                ++pos_;
+                name_ = readName();
+                size_t close = text_.find('>', pos_);
+                if (name_.empty() || close == std::string_view::npos) return Error;
+                pos_ = close + 1;
+                attribute_count_ = 0;
+                return EndElement;
+            } else {
+                return readStartTag() ? StartElement : Error;
+            }
+        }
+    }
+
+    std::string_view name() const { return name_; }
+    size_t attributeCount() const { return attribute_count_; }
+    const Attribute& attribute(size_t index) const { return attributes_[index]; }
+
+    std::string_view attribute(std::string_view name) const {
+        for (size_t i = 0; i < attribute_count_; ++i) {
+            if (attributes_[i].name == name) {
+                return attributes_[i].value;
+            }
+        }
+        return std::string_view();
+    }
+
+private:
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+    void skipSpace() {
+        while (pos_ < text_.size() && isSpace(text_[pos_])) {
+            ++pos_;
+        }
+    }
+
+    bool skipPast(std::string_view terminator) {
+        size_t end = text_.find(terminator, pos_);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        pos_ = end + terminator.size();
+        return true;
+    }
+
+    // <!DOCTYPE ...> may carry an internal subset in brackets.
+    bool skipDeclaration() {
+        int brackets = 0;
+        for (; pos_ < text_.size(); ++pos_) {
+            char c = text_[pos_];
+            if (c == '[') ++brackets;
+            else if (c == ']') --brackets;
+            else if (c == '>' && brackets <= 0) {
+                ++pos_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string_view readName() {
+        size_t start = pos_;
+        while (pos_ < text_.size() && !isSpace(text_[pos_]) && text_[pos_] != '>' && text_[pos_] != '/' &&
+               text_[pos_] != '=') {
+            ++pos_;
+        }
+        return text_.substr(start, pos_ - start);
+    }
+
+    bool readStartTag() {
+        name_ = readName();
+        attribute_count_ = 0;
+        if (name_.empty()) {
+            return false;
+        }
+        while (true) {
+            skipSpace();
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+            if (text_[pos_] == '>') {
+                ++pos_;
+                return true;
+            }
+            if (text_[pos_] == '/') {
+                if (pos_ + 1 >= text_.size() || text_[pos_ + 1] != '>') {
+                    return false;
+                }
+                pos_ += 2;
+                pending_end_ = true;
+                return true;
+            }
+
+            std::string_view attr_name = readName();
+            skipSpace();
+            if (attr_name.empty() || pos_ >= text_.size() || text_[pos_] != '=') {
+                return false;
+            }
+            ++pos_;
+            skipSpace();
+            if (pos_ >= text_.size() || (text_[pos_] != '"' && text_[pos_] != '\'')) {
+                return false;
+            }
+            char quote = text_[pos_++];
+            size_t end = text_.find(quote, pos_);
+            if (end == std::string_view::npos) {
+                return false;
+            }
+            if (attribute_count_ < kMaxAttributes) {
+                attributes_[attribute_count_++] = {attr_name, text_.substr(pos_, end - pos_)};
+            }
+            pos_ = end + 1;
+        }
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+    std::string_view name_;
+    Attribute attributes_[kMaxAttributes];
+    size_t attribute_count_ = 0;
+    bool pending_end_ = false;
+};
+
+// Interns attribute text, decoding entities through scratch only when the
+// raw value contains any.
+inline InternedString intern_xml_text(std::string_view raw, StringArena& scratch) {
+    if (raw.find('&') == std::string_view::npos) {
+        return InternedString(raw);
+    }
+    return InternedString(decode_xml_text(raw, scratch));
+}
+
+enum class MemberKind : uint8_t { Method, Signal, Property };
+
+struct IntrospectArg {
+    InternedString name;
+    InternedString type;
+    bool out; // method return value; signal args are always "out"
+};
+
+struct IntrospectAnnotation {
+    uint32_t interface_index;
+    int32_t member_index; // -1 when the annotation belongs to the interface
+    InternedString name;
+    InternedString value;
+};
+
+struct IntrospectMember {
+    MemberKind kind;
+    InternedString name;
+    InternedString type;   // properties only
+    InternedString access; // properties only: read, write or readwrite
+    uint32_t first_arg;
+    uint32_t arg_count;
+};
+
+struct IntrospectInterface {
+    InternedString name;
+    uint32_t first_member;
+    uint32_t member_count;
+};
+
+// One Introspect reply, stored flat: members are contiguous per interface and
+// args contiguous per member. Names and types are interned in the global
+// table, so they cost nothing once seen on any object; child node names are
+// per-object and live in the document's arena. Reusing a document for the
+// next reply keeps every buffer, so steady-state parsing does not touch the
+// heap.
+struct IntrospectionDocument {
+    StringArena strings;
+    std::vector<IntrospectInterface> interfaces;
+    std::vector<IntrospectMember> members;
+    std::vector<IntrospectArg> args;
+    std::vector<IntrospectAnnotation> annotations;
+    std::vector<std::string_view> children; // child node names as written
+
+    IntrospectionDocument() = default;
+    IntrospectionDocument(const IntrospectionDocument&) = delete;
+    IntrospectionDocument& operator=(const IntrospectionDocument&) = delete;
+    IntrospectionDocument(IntrospectionDocument&&) = default;
+    IntrospectionDocument& operator=(IntrospectionDocument&&) = default;
+
+    void clear() {
+        strings.clear();
+        interfaces.clear();
+        members.clear();
+        args.clear();
+        annotations.clear();
+        children.clear();
+    }
+};
+
+// Single pass over the reply. Elements of nested child nodes are skipped;
+// only their names are recorded. Returns false on malformed XML, leaving
+// whatever was parsed before the error in doc.
+inline bool parse_introspection_xml(std::string_view xml, IntrospectionDocument& doc) {
+    doc.clear();
+    XmlPullParser parser(xml);
+    int node_depth = 0;
+    bool in_interface = false;
+    bool in_member = false;
+
+    while (true) {
+        XmlPullParser::Event event = parser.next();
+        if (event == XmlPullParser::End) {
+            return node_depth == 0;
+        }
+        if (event == XmlPullParser::Error) {
+            return false;
+        }
+
+        std::string_view element = parser.name();
+        if (event == XmlPullParser::EndElement) {
+            if (element == "node") {
+                --node_depth;
+            } else if (node_depth == 1 && element == "interface") {
+                in_interface = false;
+            } else if (node_depth == 1 && (element == "method" || element == "signal" || element == "property")) {
+                in_member = false;
+            }
+            continue;
+        }
+
+        if (element == "node") {
+            if (++node_depth == 2) {
+                std::string_view name = parser.attribute("name");
+                if (!name.empty()) {
+                    doc.children.push_back(decode_xml_text(name, doc.strings));
+                }
+            }
+            continue;
+        }
+        if (node_depth != 1) {
+            continue;
+        }
+
+        if (element == "interface") {
+            in_interface = true;
+            in_member = false;
+            doc.interfaces.push_back({intern_xml_text(parser.attribute("name"), doc.strings),
+                                      static_cast<uint32_t>(doc.members.size()), 0});
+        } else if (in_interface && (element == "method" || element == "signal" || element == "property")) {
+            in_member = true;
+            IntrospectMember member{};
+            member.kind = element == "method" ? MemberKind::Method
+                        : element == "signal" ? MemberKind::Signal : MemberKind::Property;
+            member.name = intern_xml_text(parser.attribute("name"), doc.strings);
+            if (member.kind == MemberKind::Property) {
+                member.type = intern_xml_text(parser.attribute("type"), doc.strings);
+                member.access = intern_xml_text(parser.attribute("access"), doc.strings);
+            }
+            member.first_arg = static_cast<uint32_t>(doc.args.size());
+            doc.members.push_back(member);
+            doc.interfaces.back().member_count++;
+        } else if (in_member && element == "arg") {
+            IntrospectMember& member = doc.members.back();
+            std::string_view direction = parser.attribute("direction");
+            doc.args.push_back({intern_xml_text(parser.attribute("name"), doc.strings),
+                                intern_xml_text(parser.attribute("type"), doc.strings),
+                                member.kind == MemberKind::Signal || direction == "out"});
+            member.arg_count++;
+        } else if (in_interface && element == "annotation") {
+            int32_t member_index = in_member ? static_cast<int32_t>(doc.members.size() - 1) : -1;
+            doc.annotations.push_back({static_cast<uint32_t>(doc.interfaces.size() - 1), member_index,
+                                       intern_xml_text(parser.attribute("name"), doc.strings),
+                                       intern_xml_text(parser.attribute("value"), doc.strings)});
+        }
+    }
+}
+
+#endif // INTROSPECTION_XML_H
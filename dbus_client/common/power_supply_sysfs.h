@@ -0,0 +1,334 @@
+#ifndef POWER_SUPPLY_SYSFS_H
+#define POWER_SUPPLY_SYSFS_H
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include "../../common/uevent.h"
+#include "upower_device_state.h"
+
+#define POWER_SUPPLY_SYSFS_ROOT "/sys/class/power_supply"
+#define POWER_SUPPLY_READ_BUFFER_SIZE 4096
+
+// Schema index of a field this backend fills. Evaluated at compile time, so a
+// name missing from the schema fails the build instead of misindexing.
+constexpr size_t power_supply_field(std::string_view name) {
+    return find_upower_field(name) >= 0 ? static_cast<size_t>(find_upower_field(name))
+                                        : throw "unknown UPower device field";
+}
+
+// One /sys/class/power_supply entry. The uevent file stays open and is re-read
+// with pread at offset 0, which makes sysfs regenerate the attribute.
+struct PowerSupply {
+    std::string name;
+    int fd = -1;
+    UPowerDeviceState state{};
+    UPowerFieldMask present = 0;
+
+    PowerSupply() = default;
+    PowerSupply(const PowerSupply&) = delete;
+    PowerSupply& operator=(const PowerSupply&) = delete;
+
+    ~PowerSupply() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+// Reads batteries and line power straight from the kernel, filling the same
+// UPowerDeviceState the UPower backend does, with the same units and enum
+// values. Needs neither upowerd nor a bus; a refresh is one pread and one
+// pass over the KEY=VALUE lines. Not thread-safe.
+class PowerSupplySysfs {
+public:
+    explicit PowerSupplySysfs(const std::string& root = POWER_SUPPLY_SYSFS_ROOT) : root_(root) {}
+
+    PowerSupplySysfs(const PowerSupplySysfs&) = delete;
+    PowerSupplySysfs& operator=(const PowerSupplySysfs&) = delete;
+
+    // Opens newly appeared supplies and drops vanished ones. Returns the names
+    // added, so callers can report them.
+    std::set<std::string> scan() {
+        std::set<std::string> found;
+        std::set<std::string> added;
+        DIR* dir = opendir(root_.c_str());
+        if (!dir) {
+            supplies_.clear();
+            return added;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            found.insert(entry->d_name);
+            if (supplies_.count(entry->d_name)) {
+                continue;
+            }
+            std::string path = root_ + "/" + entry->d_name + "/uevent";
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            PowerSupply& supply = supplies_[entry->d_name];
+            supply.name = entry->d_name;
+            supply.fd = fd;
+            added.insert(entry->d_name);
+        }
+        closedir(dir);
+
+        for (auto it = supplies_.begin(); it != supplies_.end();) {
+            it = found.count(it->first) ? std::next(it) : supplies_.erase(it);
+        }
+        return added;
+    }
+
+    // Re-reads one supply. Returns the fields that changed; a supply that can
+    // no longer be read (unplugged) is dropped and reports nothing.
+    UPowerFieldMask refresh(const std::string& name) {
+        auto it = supplies_.find(name);
+        if (it == supplies_.end()) {
+            return 0;
+        }
+        ssize_t length = pread(it->second.fd, buffer_, sizeof(buffer_), 0);
+        if (length < 0) {
+            supplies_.erase(it);
+            return 0;
+        }
+        parse_uevent_file(buffer_, static_cast<size_t>(length), view_);
+        return apply(it->second);
+    }
+
+    const std::map<std::string, PowerSupply>& supplies() const { return supplies_; }
+    const std::string& root() const { return root_; }
+
+private:
+    static constexpr size_t kNativePath = power_supply_field("NativePath");
+    static constexpr size_t kVendor = power_supply_field("Vendor");
+    static constexpr size_t kModel = power_supply_field("Model");
+    static constexpr size_t kSerial = power_supply_field("Serial");
+    static constexpr size_t kUpdateTime = power_supply_field("UpdateTime");
+    static constexpr size_t kType = power_supply_field("Type");
+    static constexpr size_t kState = power_supply_field("State");
+    static constexpr size_t kTechnology = power_supply_field("Technology");
+    static constexpr size_t kChargeCycles = power_supply_field("ChargeCycles");
+    static constexpr size_t kTimeToEmpty = power_supply_field("TimeToEmpty");
+    static constexpr size_t kTimeToFull = power_supply_field("TimeToFull");
+    static constexpr size_t kEnergy = power_supply_field("Energy");
+    static constexpr size_t kEnergyFull = power_supply_field("EnergyFull");
+    static constexpr size_t kEnergyFullDesign = power_supply_field("EnergyFullDesign");
+    static constexpr size_t kEnergyRate = power_supply_field("EnergyRate");
+    static constexpr size_t kVoltage = power_supply_field("Voltage");
+    static constexpr size_t kPercentage = power_supply_field("Percentage");
+    static constexpr size_t kTemperature = power_supply_field("Temperature");
+    static constexpr size_t kCapacity = power_supply_field("Capacity");
+    static constexpr size_t kPowerSupply = power_supply_field("PowerSupply");
+    static constexpr size_t kOnline = power_supply_field("Online");
+    static constexpr size_t kIsPresent = power_supply_field("IsPresent");
+    static constexpr size_t kIsRechargeable = power_supply_field("IsRechargeable");
+
+    // Raw POWER_SUPPLY_* values of one read, in sysfs units (micro-units,
+    // tenths of a degree). Empty when the driver does not export the key;
+    // every value is signed, e.g. CURRENT_NOW is negative while discharging
+    // on many fuel gauges.
+    using Value = std::optional<int64_t>;
+    struct Reading {
+        std::string_view type, status, technology, scope;
+        std::string_view manufacturer, model, serial;
+        Value present, online, capacity, cycleCount, temp;
+        Value energyNow, energyFull, energyFullDesign, powerNow;
+        Value chargeNow, chargeFull, chargeFullDesign, currentNow;
+        Value voltageNow, voltageMinDesign;
+    };
+
+    static Value toInt(std::string_view text) {
+        int64_t value = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() ? Value(value) : std::nullopt;
+    }
+
+    // One pass over the lines; keys are dispatched on length first.
+    void read(Reading& r) const {
+        constexpr std::string_view prefix = "POWER_SUPPLY_";
+        for (const UeventField& entry : view_) {
+            if (entry.key.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            std::string_view key = entry.key.substr(prefix.size());
+            std::string_view value = entry.value;
+            switch (key.size()) {
+            case 4:
+                if (key == "TYPE") r.type = value;
+                else if (key == "TEMP") r.temp = toInt(value);
+                break;
+            case 5:
+                if (key == "SCOPE") r.scope = value;
+                break;
+            case 6:
+                if (key == "STATUS") r.status = value;
+                else if (key == "ONLINE") r.online = toInt(value);
+                break;
+            case 7:
+                if (key == "PRESENT") r.present = toInt(value);
+                break;
+            case 8:
+                if (key == "CAPACITY") r.capacity = toInt(value);
+                break;
+            case 9:
+                if (key == "POWER_NOW") r.powerNow = toInt(value);
+                break;
+            case 10:
+                if (key == "ENERGY_NOW") r.energyNow = toInt(value);
+                else if (key == "CHARGE_NOW") r.chargeNow = toInt(value);
+                else if (key == "TECHNOLOGY") r.technology = value;
+                else if (key == "MODEL_NAME") r.model = value;
+                break;
+            case 11:
+                if (key == "ENERGY_FULL") r.energyFull = toInt(value);
+                else if (key == "CHARGE_FULL") r.chargeFull = toInt(value);
+                else if (key == "CURRENT_NOW") r.currentNow = toInt(value);
+                else if (key == "VOLTAGE_NOW") r.voltageNow = toInt(value);
+                else if (key == "CYCLE_COUNT") r.cycleCount = toInt(value);
+                break;
+            case 12:
+                if (key == "MANUFACTURER") r.manufacturer = value;
+                break;
+            case 13:
+                if (key == "SERIAL_NUMBER") r.serial = value;
+                break;
+            case 18:
+                if (key == "ENERGY_FULL_DESIGN") r.energyFullDesign = toInt(value);
+                else if (key == "CHARGE_FULL_DESIGN") r.chargeFullDesign = toInt(value);
+                else if (key == "VOLTAGE_MIN_DESIGN") r.voltageMinDesign = toInt(value);
+                break;
+            }
+        }
+    }
+
+    // UPower's enum values: Device.Type, Device.State and Device.Technology.
+    static uint32_t deviceType(std::string_view type) {
+        if (type == "Battery") return 2;
+        if (type == "UPS") return 3;
+        if (type == "Mains" || type.compare(0, 3, "USB") == 0) return 1; // line power
+        return 0;
+    }
+
+    static uint32_t deviceState(std::string_view status) {
+        if (status == "Charging") return 1;
+        if (status == "Discharging") return 2;
+        if (status == "Empty") return 3;
+        if (status == "Full") return 4;
+        if (status == "Not charging") return 5; // pending charge
+        return 0;
+    }
+
+    static uint32_t technology(std::string_view technology) {
+        if (technology == "Li-ion") return 1;
+        if (technology == "Li-poly") return 2;
+        if (technology == "LiFe") return 3;
+        if (technology == "NiCd") return 5;
+        if (technology == "NiMH") return 6;
+        return 0;
+    }
+
+    template <typename T>
+    void set(PowerSupply& supply, size_t index, T value, UPowerFieldMask& changed) const {
+        UPowerFieldMask bit = upower_field_bit(index);
+        if (store_upower_value(supply.state, kUPowerDeviceSchema[index], value) || !(supply.present & bit)) {
+            changed |= bit;
+        }
+        supply.present |= bit;
+    }
+
+    void setString(PowerSupply& supply, size_t index, std::string_view value, UPowerFieldMask& changed) const {
+        UPowerFieldMask bit = upower_field_bit(index);
+        if (store_upower_string(supply.state, kUPowerDeviceSchema[index], value) || !(supply.present & bit)) {
+            changed |= bit;
+        }
+        supply.present |= bit;
+    }
+
+    // Converts to UPower units (Wh, W, V, degrees C) and derives what UPower
+    // derives: energy from charge when only charge is exported, capacity and
+    // time estimates.
+    UPowerFieldMask apply(PowerSupply& supply) const {
+        Reading r;
+        read(r);
+        UPowerFieldMask changed = 0;
+        uint32_t type = deviceType(r.type);
+
+        setString(supply, kNativePath, supply.name, changed);
+        set(supply, kType, type, changed);
+        if (type == 1) {
+            set(supply, kPowerSupply, true, changed);
+            if (r.online) set(supply, kOnline, *r.online > 0, changed);
+            return changed;
+        }
+
+        double voltage = r.voltageNow ? *r.voltageNow / 1e6 : 0.0;
+        double designVoltage = r.voltageMinDesign && *r.voltageMinDesign > 0 ? *r.voltageMinDesign / 1e6 : voltage;
+        auto energy = [&](const Value& energyValue, const Value& chargeValue) {
+            if (energyValue) return *energyValue / 1e6;
+            if (chargeValue) return *chargeValue / 1e6 * designVoltage;
+            return 0.0;
+        };
+        double energyNow = energy(r.energyNow, r.chargeNow);
+        double energyFull = energy(r.energyFull, r.chargeFull);
+        double energyFullDesign = energy(r.energyFullDesign, r.chargeFullDesign);
+        // The sign only encodes direction, which State already carries; UPower
+        // reports the magnitude.
+        double rate = r.powerNow ? std::abs(*r.powerNow) / 1e6
+                    : r.currentNow ? std::abs(*r.currentNow) / 1e6 * voltage : 0.0;
+        uint32_t state = deviceState(r.status);
+        double percentage = r.capacity ? static_cast<double>(*r.capacity)
+                          : energyFull > 0 ? energyNow / energyFull * 100.0 : 0.0;
+
+        setString(supply, kVendor, r.manufacturer, changed);
+        setString(supply, kModel, r.model, changed);
+        setString(supply, kSerial, r.serial, changed);
+        set(supply, kState, state, changed);
+        set(supply, kTechnology, technology(r.technology), changed);
+        set(supply, kPowerSupply, r.scope != "Device", changed);
+        set(supply, kIsRechargeable, true, changed);
+        set(supply, kIsPresent, !r.present || *r.present != 0, changed);
+        set(supply, kPercentage, percentage, changed);
+        set(supply, kEnergy, energyNow, changed);
+        set(supply, kEnergyFull, energyFull, changed);
+        set(supply, kEnergyFullDesign, energyFullDesign, changed);
+        set(supply, kEnergyRate, rate, changed);
+        set(supply, kVoltage, voltage, changed);
+        set(supply, kCapacity, energyFullDesign > 0 ? energyFull / energyFullDesign * 100.0 : 0.0, changed);
+        if (r.cycleCount) set(supply, kChargeCycles, static_cast<int32_t>(*r.cycleCount), changed);
+        if (r.temp) set(supply, kTemperature, *r.temp / 10.0, changed);
+
+        int64_t toEmpty = state == 2 && rate > 0 ? static_cast<int64_t>(energyNow / rate * 3600) : 0;
+        int64_t toFull = state == 1 && rate > 0 ? static_cast<int64_t>((energyFull - energyNow) / rate * 3600) : 0;
+        set(supply, kTimeToEmpty, toEmpty, changed);
+        set(supply, kTimeToFull, toFull, changed);
+
+        // Like UPower, UpdateTime only moves when something else did.
+        if (changed) {
+            set(supply, kUpdateTime, static_cast<uint64_t>(std::time(nullptr)), changed);
+        }
+        return changed & ~upower_field_bit(kUpdateTime);
+    }
+
+    std::string root_;
+    std::map<std::string, PowerSupply> supplies_;
+    char buffer_[POWER_SUPPLY_READ_BUFFER_SIZE];
+    UeventView view_;
+};
+
+#endif // POWER_SUPPLY_SYSFS_H
@@ -0,0 +1,62 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for strings. Views it hands out stay valid until clear();
+// clear() keeps the chunks, so a reused arena stops allocating once warm.
+class StringArena {
+public:
+    explicit StringArena(size_t chunk_size = 16 * 1024) : chunk_size_(chunk_size) {}
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    char* allocate(size_t size) {
+        while (current_ < chunks_.size() && used_ + size > chunks_[current_].size) {
+            ++current_;
+            used_ = 0;
+        }
+        if (current_ == chunks_.size()) {
+            size_t chunk = size > chunk_size_ ? size : chunk_size_;
+            chunks_.push_back({std::unique_ptr<char[]>(new char[chunk]), chunk});
+            used_ = 0;
+        }
+        char* data = chunks_[current_].data.get() + used_;
+        used_ += size;
+        return data;
+    }
+
+    std::string_view store(std::string_view text) {
+        if (text.empty()) {
+            return std::string_view();
+        }
+        char* data = allocate(text.size());
+        std::memcpy(data, text.data(), text.size());
+        return std::string_view(data, text.size());
+    }
+
+    void clear() {
+        current_ = 0;
+        used_ = 0;
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t chunk_size_;
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0;
+    size_t used_ = 0;
+};
+
+#endif // STRING_ARENA_H
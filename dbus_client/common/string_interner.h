@@ -0,0 +1,88 @@
+#ifndef STRING_INTERNER_H
+#define STRING_INTERNER_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "string_arena.h"
+
+// Deduplicating string table. Every distinct string is stored once and gets
+// a stable 32-bit id; id 0 is the empty string. Nothing is ever removed, so
+// views returned by lookup() live as long as the interner. Not thread-safe.
+class StringInterner {
+public:
+    StringInterner() {
+        strings_.push_back(std::string_view());
+    }
+
+    StringInterner(const StringInterner&) = delete;
+    StringInterner& operator=(const StringInterner&) = delete;
+
+    uint32_t intern(std::string_view text) {
+        if (text.empty()) {
+            return 0;
+        }
+        auto it = ids_.find(text);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+        std::string_view stored = arena_.store(text);
+        uint32_t id = static_cast<uint32_t>(strings_.size());
+        strings_.push_back(stored);
+        ids_.emplace(stored, id);
+        return id;
+    }
+
+    std::string_view lookup(uint32_t id) const { return strings_[id]; }
+    size_t size() const { return strings_.size() - 1; }
+
+private:
+    StringArena arena_;
+    std::vector<std::string_view> strings_;
+    std::unordered_map<std::string_view, uint32_t> ids_;
+};
+
+// Process-wide table shared by every introspection result, so an interface
+// or member name seen on a thousand objects is stored once.
+inline StringInterner& global_interner() {
+    static StringInterner interner;
+    return interner;
+}
+
+// Handle to a globally interned string: four bytes, compared by id. Building
+// one from text costs a hash lookup; everything after that is integer work.
+class InternedString {
+public:
+    InternedString() = default;
+    InternedString(std::string_view text) : id_(global_interner().intern(text)) {}
+    InternedString(const char* text) : InternedString(std::string_view(text ? text : "")) {}
+
+    std::string_view str() const { return global_interner().lookup(id_); }
+    uint32_t id() const { return id_; }
+    bool empty() const { return id_ == 0; }
+
+    bool operator==(InternedString other) const { return id_ == other.id_; }
+    bool operator!=(InternedString other) const { return id_ != other.id_; }
+    // Orders by id, not alphabetically; enough for map keys.
+    bool operator<(InternedString other) const { return id_ < other.id_; }
+
+private:
+    uint32_t id_ = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& out, InternedString value) {
+    return out << value.str();
+}
+
+namespace std {
+template <>
+struct hash<InternedString> {
+    size_t operator()(InternedString value) const { return value.id(); }
+};
+}
+
+#endif // STRING_INTERNER_H
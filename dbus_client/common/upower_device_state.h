@@ -0,0 +1,184 @@
+#ifndef UPOWER_DEVICE_STATE_H
+#define UPOWER_DEVICE_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Room for string properties, including the terminating NUL. Longer values
+// are truncated.
+#define UPOWER_STRING_SIZE 64
+
+// Every property of org.freedesktop.UPower.Device in native form. Plain
+// data: copying, comparing or zeroing it never touches the heap.
+struct UPowerDeviceState {
+    char nativePath[UPOWER_STRING_SIZE];
+    char vendor[UPOWER_STRING_SIZE];
+    char model[UPOWER_STRING_SIZE];
+    char serial[UPOWER_STRING_SIZE];
+    char iconName[UPOWER_STRING_SIZE];
+    uint64_t updateTime;
+    uint32_t type;
+    uint32_t state;
+    uint32_t technology;
+    uint32_t warningLevel;
+    uint32_t batteryLevel;
+    int32_t chargeCycles;
+    int64_t timeToEmpty;
+    int64_t timeToFull;
+    double energy;
+    double energyEmpty;
+    double energyFull;
+    double energyFullDesign;
+    double energyRate;
+    double voltage;
+    double luminosity;
+    double percentage;
+    double temperature;
+    double capacity;
+    bool powerSupply;
+    bool hasHistory;
+    bool hasStatistics;
+    bool online;
+    bool isPresent;
+    bool isRechargeable;
+};
+
+static_assert(std::is_trivially_copyable<UPowerDeviceState>::value, "UPowerDeviceState must stay plain data");
+
+// D-Bus type codes, so a variant's type can be checked against the schema
+// without translation.
+enum class UPowerFieldType : char {
+    String = 's',
+    Boolean = 'b',
+    Int32 = 'i',
+    UInt32 = 'u',
+    Int64 = 'x',
+    UInt64 = 't',
+    Double = 'd',
+};
+
+struct UPowerField {
+    const char* name; // D-Bus property name
+    UPowerFieldType type;
+    size_t offset;
+    size_t size;
+};
+
+// One bit per schema entry, in schema order.
+using UPowerFieldMask = uint64_t;
+
+#define UPOWER_FIELD(name, type, member) \
+    UPowerField{name, UPowerFieldType::type, offsetof(UPowerDeviceState, member), sizeof(UPowerDeviceState::member)}
+
+constexpr UPowerField kUPowerDeviceSchema[] = {
+    UPOWER_FIELD("NativePath", String, nativePath),
+    UPOWER_FIELD("Vendor", String, vendor),
+    UPOWER_FIELD("Model", String, model),
+    UPOWER_FIELD("Serial", String, serial),
+    UPOWER_FIELD("IconName", String, iconName),
+    UPOWER_FIELD("UpdateTime", UInt64, updateTime),
+    UPOWER_FIELD("Type", UInt32, type),
+    UPOWER_FIELD("State", UInt32, state),
+    UPOWER_FIELD("Technology", UInt32, technology),
+    UPOWER_FIELD("WarningLevel", UInt32, warningLevel),
+    UPOWER_FIELD("BatteryLevel", UInt32, batteryLevel),
+    UPOWER_FIELD("ChargeCycles", Int32, chargeCycles),
+    UPOWER_FIELD("TimeToEmpty", Int64, timeToEmpty),
+    UPOWER_FIELD("TimeToFull", Int64, timeToFull),
+    UPOWER_FIELD("Energy", Double, energy),
+    UPOWER_FIELD("EnergyEmpty", Double, energyEmpty),
+    UPOWER_FIELD("EnergyFull", Double, energyFull),
+    UPOWER_FIELD("EnergyFullDesign", Double, energyFullDesign),
+    UPOWER_FIELD("EnergyRate", Double, energyRate),
+    UPOWER_FIELD("Voltage", Double, voltage),
+    UPOWER_FIELD("Luminosity", Double, luminosity),
+    UPOWER_FIELD("Percentage", Double, percentage),
+    UPOWER_FIELD("Temperature", Double, temperature),
+    UPOWER_FIELD("Capacity", Double, capacity),
+    UPOWER_FIELD("PowerSupply", Boolean, powerSupply),
+    UPOWER_FIELD("HasHistory", Boolean, hasHistory),
+    UPOWER_FIELD("HasStatistics", Boolean, hasStatistics),
+    UPOWER_FIELD("Online", Boolean, online),
+    UPOWER_FIELD("IsPresent", Boolean, isPresent),
+    UPOWER_FIELD("IsRechargeable", Boolean, isRechargeable),
+};
+
+#undef UPOWER_FIELD
+
+constexpr size_t kUPowerFieldCount = sizeof(kUPowerDeviceSchema) / sizeof(kUPowerDeviceSchema[0]);
+static_assert(kUPowerFieldCount <= 64, "UPowerFieldMask has one bit per field");
+
+constexpr UPowerFieldMask upower_field_bit(size_t index) {
+    return UPowerFieldMask(1) << index;
+}
+
+// Schema index of a property, or -1 for names UPower added after this table.
+// constexpr so backends can resolve fixed names at compile time.
+constexpr int find_upower_field(std::string_view name) {
+    for (size_t i = 0; i < kUPowerFieldCount; ++i) {
+        if (name == kUPowerDeviceSchema[i].name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+inline char* upower_field_data(UPowerDeviceState& state, const UPowerField& field) {
+    return reinterpret_cast<char*>(&state) + field.offset;
+}
+
+inline const char* upower_field_data(const UPowerDeviceState& state, const UPowerField& field) {
+    return reinterpret_cast<const char*>(&state) + field.offset;
+}
+
+// Stores a numeric or boolean value. T must match the field's native type.
+// Returns true if the stored bytes changed.
+template <typename T>
+inline bool store_upower_value(UPowerDeviceState& state, const UPowerField& field, T value) {
+    static_assert(std::is_arithmetic<T>::value, "strings go through store_upower_string");
+    char* slot = upower_field_data(state, field);
+    if (field.size != sizeof(T) || std::memcmp(slot, &value, sizeof(T)) == 0) {
+        return false;
+    }
+    std::memcpy(slot, &value, sizeof(T));
+    return true;
+}
+
+// Stores a string, truncated and zero-padded so equal text means equal bytes.
+inline bool store_upower_string(UPowerDeviceState& state, const UPowerField& field, std::string_view value) {
+    char buffer[UPOWER_STRING_SIZE] = {};
+    std::memcpy(buffer, value.data(), value.size() < UPOWER_STRING_SIZE ? value.size() : UPOWER_STRING_SIZE - 1);
+    char* slot = upower_field_data(state, field);
+    if (std::memcmp(slot, buffer, UPOWER_STRING_SIZE) == 0) {
+        return false;
+    }
+    std::memcpy(slot, buffer, UPOWER_STRING_SIZE);
+    return true;
+}
+
+inline std::string format_upower_field(const UPowerDeviceState& state, const UPowerField& field) {
+    const char* data = upower_field_data(state, field);
+    switch (field.type) {
+    case UPowerFieldType::String:
+        return data;
+    case UPowerFieldType::Boolean:
+        return *reinterpret_cast<const bool*>(data) ? "true" : "false";
+    case UPowerFieldType::Int32:
+        return std::to_string(*reinterpret_cast<const int32_t*>(data));
+    case UPowerFieldType::UInt32:
+        return std::to_string(*reinterpret_cast<const uint32_t*>(data));
+    case UPowerFieldType::Int64:
+        return std::to_string(*reinterpret_cast<const int64_t*>(data));
+    case UPowerFieldType::UInt64:
+        return std::to_string(*reinterpret_cast<const uint64_t*>(data));
+    case UPowerFieldType::Double:
+        return std::to_string(*reinterpret_cast<const double*>(data));
+    }
+    return std::string();
+}
+
+#endif // UPOWER_DEVICE_STATE_H
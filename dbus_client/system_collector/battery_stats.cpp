@@ -3,38 +3,221 @@
 #include <cstdlib>
 #include <string>
 #include <cstring>
-#include <unistd.h>
 #include <vector>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <ctime>
+#include <set>
+#include <thread>
+
+#include "../common/dbus_async.h"
+#include "../common/upower_device_state.h"
+#include "../common/power_supply_sysfs.h"
+#include "../../common/uevent_monitor.h"
+
+// One sample of org.freedesktop.UPower.Device.GetHistory, signature (udu).
+struct HistoryPoint {
+    uint32_t time;  // seconds since the epoch
+    uint32_t state; // UPower device state at that time
+    double value;   // percent for "charge", watts for "rate"
+};
+
+// One bucket of GetStatistics, signature (dd).
+struct StatisticsPoint {
+    double value;
+    double accuracy;
+};
+
+// Points requested per GetHistory call; UPower averages down to this many.
+#define UPOWER_HISTORY_RESOLUTION 500
+// Oldest points are dropped beyond this, about a week at one per minute.
+#define UPOWER_HISTORY_MAX_POINTS 10080
+
+// Time series for one history type, oldest first. Each fetch only asks for
+// the span since the newest point held and appends what is newer, so a
+// long-running monitor pays for new samples only.
+class UPowerHistory {
+public:
+    uint32_t lastTime() const { return points_.empty() ? 0 : points_.back().time; }
+    const std::vector<HistoryPoint>& points() const { return points_; }
+
+    // Merges a GetHistory reply (newest first). Returns the points added.
+    size_t merge(DBusMessage* reply) {
+        DBusMessageIter args;
+        if (!dbus_message_has_signature(reply, "a(udu)") || !dbus_message_iter_init(reply, &args)) {
+            std::cerr << "Unexpected GetHistory reply signature" << std::endl;
+            return 0;
+        }
+
+        scratch_.clear();
+        DBusMessageIter arrayIter;
+        dbus_message_iter_recurse(&args, &arrayIter);
+        uint32_t last = lastTime();
+        while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRUCT) {
+            DBusMessageIter structIter;
+            dbus_message_iter_recurse(&arrayIter, &structIter);
+            HistoryPoint point;
+            dbus_message_iter_get_basic(&structIter, &point.time);
+            dbus_message_iter_next(&structIter);
+            dbus_message_iter_get_basic(&structIter, &point.value);
+            dbus_message_iter_next(&structIter);
+            dbus_message_iter_get_basic(&structIter, &point.state);
+            if (point.time > last) {
+                scratch_.push_back(point);
+            }
+            dbus_message_iter_next(&arrayIter);
+        }
+
+        // Sort rather than trust the order, then drop duplicate timestamps.
+        std::sort(scratch_.begin(), scratch_.end(),
+                  [](const HistoryPoint& a, const HistoryPoint& b) { return a.time < b.time; });
+        size_t added = 0;
+        for (const HistoryPoint& point : scratch_) {
+            if (points_.empty() || point.time > points_.back().time) {
+                points_.push_back(point);
+                ++added;
+            }
+        }
+        if (points_.size() > UPOWER_HISTORY_MAX_POINTS) {
+            points_.erase(points_.begin(), points_.end() - UPOWER_HISTORY_MAX_POINTS);
+        }
+        return added;
+    }
+
+private:
+    std::vector<HistoryPoint> points_;
+    std::vector<HistoryPoint> scratch_;
+};
 
 class UPowerDevice {
 public:
     UPowerDevice(DBusConnection* connection, const std::string& devicePath);
 
     void requestProperties();
+    void requestProperties(DBusCallQueue& calls);
     void printProperties() const;
-    void updateProperty(const std::string& propertyName, const std::string& value);
+    bool handlePropertiesChanged(DBusMessage* message);
+    const std::string& path() const { return devicePath_; }
+    void requestHistory(DBusCallQueue& calls, uint32_t timespan);
+    void requestStatistics(DBusCallQueue& calls);
+    const UPowerDeviceState& state() const { return state_; }
+    // Fields UPower has reported at least once.
+    UPowerFieldMask present() const { return present_; }
 
 private:
-    std::string getProperty(const std::string& propertyName);
+    UPowerFieldMask updateFromDict(DBusMessageIter* dictIter);
+    void getHistory(DBusCallQueue& calls, const char* type, UPowerHistory& history, uint32_t timespan);
+    void getStatistics(DBusCallQueue& calls, const char* type, std::vector<StatisticsPoint>& statistics);
     DBusConnection* connection_;
     std::string devicePath_;
-    std::map<std::string, std::string> properties_;
+    UPowerDeviceState state_{};
+    UPowerFieldMask present_ = 0;
+    UPowerHistory chargeHistory_;
+    UPowerHistory rateHistory_;
+    std::vector<StatisticsPoint> chargingStatistics_;
+    std::vector<StatisticsPoint> dischargingStatistics_;
 };
 
 UPowerDevice::UPowerDevice(DBusConnection* connection, const std::string& devicePath)
     : connection_(connection), devicePath_(devicePath) {}
 
-std::string UPowerDevice::getProperty(const std::string& propertyName) {
+// Decodes a variant straight into its schema slot. Returns false when the
+// variant's type does not match the schema, leaving the slot untouched.
+bool decodeField(DBusMessageIter* variantIter, UPowerDeviceState& state, const UPowerField& field, bool& changed) {
+    if (dbus_message_iter_get_arg_type(variantIter) != static_cast<int>(field.type)) {
+        return false;
+    }
+    switch (field.type) {
+    case UPowerFieldType::String: {
+        const char* v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_string(state, field, v);
+        return true;
+    }
+    case UPowerFieldType::Boolean: {
+        dbus_bool_t v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_value(state, field, static_cast<bool>(v));
+        return true;
+    }
+    case UPowerFieldType::Int32: {
+        dbus_int32_t v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_value(state, field, static_cast<int32_t>(v));
+        return true;
+    }
+    case UPowerFieldType::UInt32: {
+        dbus_uint32_t v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_value(state, field, static_cast<uint32_t>(v));
+        return true;
+    }
+    case UPowerFieldType::Int64: {
+        dbus_int64_t v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_value(state, field, static_cast<int64_t>(v));
+        return true;
+    }
+    case UPowerFieldType::UInt64: {
+        dbus_uint64_t v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_value(state, field, static_cast<uint64_t>(v));
+        return true;
+    }
+    case UPowerFieldType::Double: {
+        double v;
+        dbus_message_iter_get_basic(variantIter, &v);
+        changed = store_upower_value(state, field, v);
+        return true;
+    }
+    }
+    return false;
+}
+
+// Merges an a{sv} dict into the state. Returns the fields that changed,
+// counting a field's first appearance as a change.
+UPowerFieldMask UPowerDevice::updateFromDict(DBusMessageIter* dictIter) {
+    UPowerFieldMask changed = 0;
+    while (dbus_message_iter_get_arg_type(dictIter) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entryIter;
+        dbus_message_iter_recurse(dictIter, &entryIter);
+        const char* name;
+        dbus_message_iter_get_basic(&entryIter, &name);
+        dbus_message_iter_next(&entryIter);
+        int index = find_upower_field(name);
+        if (index >= 0 && DBUS_TYPE_VARIANT == dbus_message_iter_get_arg_type(&entryIter)) {
+            DBusMessageIter variantIter;
+            dbus_message_iter_recurse(&entryIter, &variantIter);
+            bool fieldChanged = false;
+            UPowerFieldMask bit = upower_field_bit(index);
+            // A value of the wrong type is skipped, not shown as a zero UPower never sent.
+            if (decodeField(&variantIter, state_, kUPowerDeviceSchema[index], fieldChanged)) {
+                if (fieldChanged || !(present_ & bit)) {
+                    changed |= bit;
+                }
+                present_ |= bit;
+            }
+        }
+        dbus_message_iter_next(dictIter);
+    }
+    return changed;
+}
+
+// Fetches every property with a single org.freedesktop.DBus.Properties.GetAll
+// call and decodes the a{sv} reply in place. The reply is applied when the
+// queue completes it, so several devices can be refreshed in one round trip.
+void UPowerDevice::requestProperties(DBusCallQueue& calls) {
     DBusMessage* msg;
-    DBusMessage* reply;
-    DBusError error;
-    dbus_error_init(&error);
 
-    msg = dbus_message_new_method_call("org.freedesktop.UPower",               
-                                       devicePath_.c_str(),                    
-                                       "org.freedesktop.DBus.Properties",      
-                                       "Get");                                 
+    msg = dbus_message_new_method_call("org.freedesktop.UPower",
+                                       devicePath_.c_str(),
+                                       "org.freedesktop.DBus.Properties",
+                                       "GetAll");
 
     if (!msg) {
         std::cerr << "Failed to create message" << std::endl;
@@ -42,95 +225,322 @@ std::string UPowerDevice::getProperty(const std::string& propertyName) {
     }
 
     const char* interfaceName = "org.freedesktop.UPower.Device";
-    dbus_message_append_args(msg, DBUS_TYPE_STRING, &interfaceName, DBUS_TYPE_STRING, &propertyName, DBUS_TYPE_INVALID);
-
-    reply = dbus_connection_send_with_reply_and_block(connection_, msg, -1, &error);
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &interfaceName, DBUS_TYPE_INVALID);
 
-    std::string propertyValue;
-    if (dbus_error_is_set(&error)) {
-        std::cerr << "Error in D-Bus method call: " << error.message << std::endl;
-        dbus_error_free(&error);
-    } else if (reply) {
+    calls.call(msg, [this](const DBusCallResult& result) {
+        if (!result.ok()) {
+            std::cerr << "Error in D-Bus method call: " << result.error_message << std::endl;
+            return;
+        }
         DBusMessageIter args;
-        if (dbus_message_iter_init(reply, &args)) {
-            if (DBUS_TYPE_VARIANT == dbus_message_iter_get_arg_type(&args)) {
-                DBusMessageIter variantIter;
-                dbus_message_iter_recurse(&args, &variantIter);
-                int argType = dbus_message_iter_get_arg_type(&variantIter);
-                if (argType == DBUS_TYPE_STRING) {
-                    const char* value;
-                    dbus_message_iter_get_basic(&variantIter, &value);
-                    propertyValue = value;
-                } else if (argType == DBUS_TYPE_BOOLEAN) {
-                    bool value;
-                    dbus_message_iter_get_basic(&variantIter, &value);
-                    propertyValue = value ? "true" : "false";
-                } else if (argType == DBUS_TYPE_UINT32) {
-                    uint32_t value;
-                    dbus_message_iter_get_basic(&variantIter, &value);
-                    propertyValue = std::to_string(value);
-                } else if (argType == DBUS_TYPE_DOUBLE) {
-                    double value;
-                    dbus_message_iter_get_basic(&variantIter, &value);
-                    propertyValue = std::to_string(value);
-                }
-                // Add more types as needed
-            }
+        if (dbus_message_iter_init(result.reply, &args) && DBUS_TYPE_ARRAY == dbus_message_iter_get_arg_type(&args)) {
+            DBusMessageIter dictIter;
+            dbus_message_iter_recurse(&args, &dictIter);
+            updateFromDict(&dictIter);
+        }
+    });
+
+    dbus_message_unref(msg);
+}
+
+void UPowerDevice::requestProperties() {
+    DBusCallQueue calls(connection_);
+    requestProperties(calls);
+    calls.wait();
+}
+
+// Fetches history of type ("charge" or "rate") in one call. The first fetch
+// covers timespan seconds; later ones only the time since the newest point
+// held.
+void UPowerDevice::getHistory(DBusCallQueue& calls, const char* type, UPowerHistory& history, uint32_t timespan) {
+    uint32_t last = history.lastTime();
+    if (last != 0) {
+        uint32_t now = static_cast<uint32_t>(std::time(nullptr));
+        timespan = now > last ? now - last + 1 : 1;
+    }
+    uint32_t resolution = UPOWER_HISTORY_RESOLUTION;
+
+    DBusMessage* msg;
+
+    msg = dbus_message_new_method_call("org.freedesktop.UPower",
+                                       devicePath_.c_str(),
+                                       "org.freedesktop.UPower.Device",
+                                       "GetHistory");
+
+    if (!msg) {
+        std::cerr << "Failed to create message" << std::endl;
+        std::exit(1);
+    }
+
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &type, DBUS_TYPE_UINT32, &timespan,
+                             DBUS_TYPE_UINT32, &resolution, DBUS_TYPE_INVALID);
+
+    calls.call(msg, [this, type, &history](const DBusCallResult& result) {
+        if (!result.ok()) {
+            std::cerr << "Error in D-Bus method call: " << result.error_message << std::endl;
+            return;
+        }
+        size_t added = history.merge(result.reply);
+        if (added == 0) {
+            return;
         }
-        dbus_message_unref(reply);
+        const HistoryPoint& latest = history.points().back();
+        std::cout << devicePath_ << " " << type << " history: +" << added << " points, "
+                  << history.points().size() << " held, latest " << latest.value << " at " << latest.time << std::endl;
+    });
+
+    dbus_message_unref(msg);
+}
+
+// Statistics are a fixed table per type, so each reply replaces the old one.
+void UPowerDevice::getStatistics(DBusCallQueue& calls, const char* type, std::vector<StatisticsPoint>& statistics) {
+    DBusMessage* msg;
+
+    msg = dbus_message_new_method_call("org.freedesktop.UPower",
+                                       devicePath_.c_str(),
+                                       "org.freedesktop.UPower.Device",
+                                       "GetStatistics");
+
+    if (!msg) {
+        std::cerr << "Failed to create message" << std::endl;
+        std::exit(1);
     }
 
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &type, DBUS_TYPE_INVALID);
+
+    calls.call(msg, [this, type, &statistics](const DBusCallResult& result) {
+        if (!result.ok()) {
+            std::cerr << "Error in D-Bus method call: " << result.error_message << std::endl;
+            return;
+        }
+        DBusMessageIter args;
+        if (!dbus_message_has_signature(result.reply, "a(dd)") || !dbus_message_iter_init(result.reply, &args)) {
+            std::cerr << "Unexpected GetStatistics reply signature" << std::endl;
+            return;
+        }
+        statistics.clear();
+        DBusMessageIter arrayIter;
+        dbus_message_iter_recurse(&args, &arrayIter);
+        while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRUCT) {
+            DBusMessageIter structIter;
+            dbus_message_iter_recurse(&arrayIter, &structIter);
+            StatisticsPoint point;
+            dbus_message_iter_get_basic(&structIter, &point.value);
+            dbus_message_iter_next(&structIter);
+            dbus_message_iter_get_basic(&structIter, &point.accuracy);
+            statistics.push_back(point);
+            dbus_message_iter_next(&arrayIter);
+        }
+        std::cout << devicePath_ << " " << type << " statistics: " << statistics.size() << " entries" << std::endl;
+    });
+
     dbus_message_unref(msg);
-    return propertyValue;
 }
 
-void UPowerDevice::updateProperty(const std::string& propertyName, const std::string& value) {
-    properties_[propertyName] = value;
+// Queues charge and rate history when UPower keeps any for this device.
+void UPowerDevice::requestHistory(DBusCallQueue& calls, uint32_t timespan) {
+    if (!state_.hasHistory) {
+        return;
+    }
+    getHistory(calls, "charge", chargeHistory_, timespan);
+    getHistory(calls, "rate", rateHistory_, timespan);
 }
 
-void UPowerDevice::requestProperties() {
-    std::vector<std::string> propertyNames = {
-        "BatteryLevel", "Capacity", "ChargeCycles", "Energy", "EnergyFull",
-        "EnergyFullDesign", "EnergyRate", "HasHistory", "HasStatistics",
-        "IconName", "IsPresent", "IsRechargeable", "Model", "NativePath",
-        "Online", "Percentage", "PowerSupply", "Serial", "State", "Technology",
-        "Temperature", "TimeToEmpty", "TimeToFull", "Type", "UpdateTime",
-        "Vendor", "Voltage", "WarningLevel"
-    };
+void UPowerDevice::requestStatistics(DBusCallQueue& calls) {
+    if (!state_.hasStatistics) {
+        return;
+    }
+    getStatistics(calls, "charging", chargingStatistics_);
+    getStatistics(calls, "discharging", dischargingStatistics_);
+}
 
-    for (const auto& propertyName : propertyNames) {
-        std::string value = getProperty(propertyName);
-        updateProperty(propertyName, value);
+// Prints the selected fields in schema order, each line after prefix.
+void printFields(const std::string& prefix, const UPowerDeviceState& state, UPowerFieldMask fields) {
+    for (size_t i = 0; i < kUPowerFieldCount; ++i) {
+        if (fields & upower_field_bit(i)) {
+            const UPowerField& field = kUPowerDeviceSchema[i];
+            std::cout << prefix << field.name << ": " << format_upower_field(state, field) << std::endl;
+        }
     }
 }
 
 void UPowerDevice::printProperties() const {
-    for (const auto& [name, value] : properties_) {
-        std::cout << name << ": " << value << std::endl;
+    printFields("", state_, present_);
+}
+
+// Applies a PropertiesChanged(s a{sv} as) signal to the cache and prints what
+// changed. Invalidated properties carry no value, so they trigger a refetch.
+bool UPowerDevice::handlePropertiesChanged(DBusMessage* message) {
+    DBusMessageIter args;
+    if (!dbus_message_iter_init(message, &args) || dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_STRING) {
+        return false;
+    }
+    const char* interfaceName;
+    dbus_message_iter_get_basic(&args, &interfaceName);
+    if (strcmp(interfaceName, "org.freedesktop.UPower.Device") != 0) {
+        return false;
     }
+
+    UPowerFieldMask changed = 0;
+    bool invalidated = false;
+    if (dbus_message_iter_next(&args) && dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
+        DBusMessageIter dictIter;
+        dbus_message_iter_recurse(&args, &dictIter);
+        changed = updateFromDict(&dictIter);
+    }
+    if (dbus_message_iter_next(&args) && dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
+        DBusMessageIter invalidatedIter;
+        dbus_message_iter_recurse(&args, &invalidatedIter);
+        invalidated = dbus_message_iter_get_arg_type(&invalidatedIter) == DBUS_TYPE_STRING;
+    }
+
+    if (invalidated) {
+        requestProperties();
+    }
+    printFields(devicePath_ + " ", state_, changed);
+    return true;
 }
 
+// One row of org.freedesktop.UPower.Wakeups.GetData, signature (budss).
+struct WakeupEntry {
+    bool isUserspace = false;
+    uint32_t id = 0;
+    double value = 0.0;   // wakeups per second
+    std::string cmdline;
+    std::string details;
+};
+
+enum class WakeupChange { Added, Changed, Removed };
+
+struct WakeupDelta {
+    WakeupChange change;
+    WakeupEntry entry;
+};
+
+// Number of deltas kept; older ones are overwritten.
+#define WAKEUP_HISTORY_SIZE 256
+
+// Fixed-capacity ring of recent deltas. Slots are reused in place, so once
+// every slot has held an entry the strings stop reallocating.
+class WakeupHistory {
+public:
+    WakeupDelta& push() {
+        WakeupDelta& slot = slots_[(start_ + size_) % WAKEUP_HISTORY_SIZE];
+        if (size_ < WAKEUP_HISTORY_SIZE) {
+            ++size_;
+        } else {
+            start_ = (start_ + 1) % WAKEUP_HISTORY_SIZE;
+        }
+        return slot;
+    }
+
+    size_t size() const { return size_; }
+    // 0 is the oldest delta still held.
+    const WakeupDelta& operator[](size_t index) const { return slots_[(start_ + index) % WAKEUP_HISTORY_SIZE]; }
+
+private:
+    std::array<WakeupDelta, WAKEUP_HISTORY_SIZE> slots_;
+    size_t start_ = 0;
+    size_t size_ = 0;
+};
+
 class UPowerWakeups {
 public:
     UPowerWakeups(DBusConnection* connection);
 
     void requestData();
+    void requestData(DBusCallQueue& calls);
     void printData() const;
+    void printChanges() const;
 
 private:
-    std::string getData();
+    struct Slot {
+        WakeupEntry entry;
+        uint64_t sample; // last sample the source appeared in
+    };
+
+    static uint64_t key(bool isUserspace, uint32_t id) { return (static_cast<uint64_t>(isUserspace) << 32) | id; }
+
+    void getData(DBusCallQueue& calls);
+    void applySample(DBusMessage* reply);
+    void record(WakeupChange change, const WakeupEntry& entry);
+
     DBusConnection* connection_;
-    std::vector<std::string> data_;
+    std::unordered_map<uint64_t, Slot> current_;
+    WakeupHistory history_;
+    uint64_t sample_ = 0;
+    size_t lastChanges_ = 0; // deltas produced by the latest sample
 };
 
 UPowerWakeups::UPowerWakeups(DBusConnection* connection)
     : connection_(connection) {}
 
-std::string UPowerWakeups::getData() {
+void UPowerWakeups::record(WakeupChange change, const WakeupEntry& entry) {
+    WakeupDelta& delta = history_.push();
+    delta.change = change;
+    delta.entry = entry;
+    ++lastChanges_;
+}
+
+// Decodes the reply in one pass and diffs it against the previous sample.
+// Strings are only copied for sources that are new or whose text changed.
+void UPowerWakeups::applySample(DBusMessage* reply) {
+    DBusMessageIter args;
+    if (!dbus_message_has_signature(reply, "a(budss)") || !dbus_message_iter_init(reply, &args)) {
+        std::cerr << "Unexpected GetData reply signature" << std::endl;
+        return;
+    }
+
+    ++sample_;
+    lastChanges_ = 0;
+    DBusMessageIter arrayIter;
+    dbus_message_iter_recurse(&args, &arrayIter);
+    while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRUCT) {
+        DBusMessageIter structIter;
+        dbus_message_iter_recurse(&arrayIter, &structIter);
+        dbus_bool_t isUserspace;
+        dbus_uint32_t id;
+        double value;
+        const char* cmdline;
+        const char* details;
+        dbus_message_iter_get_basic(&structIter, &isUserspace);
+        dbus_message_iter_next(&structIter);
+        dbus_message_iter_get_basic(&structIter, &id);
+        dbus_message_iter_next(&structIter);
+        dbus_message_iter_get_basic(&structIter, &value);
+        dbus_message_iter_next(&structIter);
+        dbus_message_iter_get_basic(&structIter, &cmdline);
+        dbus_message_iter_next(&structIter);
+        dbus_message_iter_get_basic(&structIter, &details);
+        dbus_message_iter_next(&arrayIter);
+
+        auto [it, added] = current_.try_emplace(key(isUserspace, id));
+        Slot& slot = it->second;
+        slot.sample = sample_;
+        WakeupEntry& entry = slot.entry;
+        if (!added && entry.value == value && entry.cmdline == cmdline && entry.details == details) {
+            continue;
+        }
+        entry.isUserspace = isUserspace;
+        entry.id = id;
+        entry.value = value;
+        if (entry.cmdline != cmdline) entry.cmdline = cmdline;
+        if (entry.details != details) entry.details = details;
+        record(added ? WakeupChange::Added : WakeupChange::Changed, entry);
+    }
+
+    for (auto it = current_.begin(); it != current_.end();) {
+        if (it->second.sample != sample_) {
+            record(WakeupChange::Removed, it->second.entry);
+            it = current_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void UPowerWakeups::getData(DBusCallQueue& calls) {
     DBusMessage* msg;
-    DBusMessage* reply;
-    DBusError error;
-    dbus_error_init(&error);
 
     msg = dbus_message_new_method_call("org.freedesktop.UPower",
                                        "/org/freedesktop/UPower/Wakeups",
@@ -142,47 +552,177 @@ std::string UPowerWakeups::getData() {
         std::exit(1);
     }
 
-    reply = dbus_connection_send_with_reply_and_block(connection_, msg, -1, &error);
+    calls.call(msg, [this](const DBusCallResult& result) {
+        if (!result.ok()) {
+            std::cerr << "Error in D-Bus method call: " << result.error_message << std::endl;
+            return;
+        }
+        applySample(result.reply);
+    });
+
+    dbus_message_unref(msg);
+}
+
+void UPowerWakeups::requestData(DBusCallQueue& calls) {
+    getData(calls);
+}
+
+void UPowerWakeups::requestData() {
+    DBusCallQueue calls(connection_);
+    getData(calls);
+    calls.wait();
+}
+
+void printWakeupEntry(const char* label, const WakeupEntry& entry) {
+    std::cout << label << (entry.isUserspace ? "user " : "kernel ") << entry.id << " "
+              << entry.value << "/s " << entry.cmdline << " " << entry.details << std::endl;
+}
+
+void UPowerWakeups::printData() const {
+    for (const auto& [id, slot] : current_) {
+        printWakeupEntry("Wakeup Data: ", slot.entry);
+    }
+}
+
+void UPowerWakeups::printChanges() const {
+    // The latest sample's deltas are the newest ones in the ring.
+    size_t count = std::min(lastChanges_, history_.size());
+    for (size_t i = history_.size() - count; i < history_.size(); ++i) {
+        const WakeupDelta& delta = history_[i];
+        printWakeupEntry(delta.change == WakeupChange::Added ? "Wakeup Added: "
+                         : delta.change == WakeupChange::Changed ? "Wakeup Changed: " : "Wakeup Removed: ",
+                         delta.entry);
+    }
+}
+
+// Every device UPower exports, keyed by object path. Devices are owned
+// through unique_ptr so their addresses stay put while others come and go.
+// EnumerateDevices seeds the set; DeviceAdded and DeviceRemoved keep it
+// current, and each new device is fetched with a single GetAll.
+class UPowerDeviceTracker {
+public:
+    explicit UPowerDeviceTracker(DBusConnection* connection) : connection_(connection) {}
+
+    void addMatches() const;
+    void enumerate(DBusCallQueue& calls);
+    void requestProperties(DBusCallQueue& calls);
+    void requestHistory(DBusCallQueue& calls, uint32_t timespan);
+    void printProperties() const;
+    UPowerDevice* add(const std::string& path, DBusCallQueue& calls);
+    bool remove(const std::string& path);
+    UPowerDevice* find(const char* path);
+    size_t size() const { return devices_.size(); }
+
+private:
+    DBusConnection* connection_;
+    std::map<std::string, std::unique_ptr<UPowerDevice>> devices_;
+};
 
-    std::string dataValue;
-    if (dbus_error_is_set(&error)) {
-        std::cerr << "Error in D-Bus method call: " << error.message << std::endl;
-        dbus_error_free(&error);
-    } else if (reply) {
+void UPowerDeviceTracker::addMatches() const {
+    dbus_bus_add_match(connection_,
+        "type='signal',sender='org.freedesktop.UPower',interface='org.freedesktop.UPower',member='DeviceAdded'",
+        nullptr);
+    dbus_bus_add_match(connection_,
+        "type='signal',sender='org.freedesktop.UPower',interface='org.freedesktop.UPower',member='DeviceRemoved'",
+        nullptr);
+    // One rule for every device instead of one per path.
+    dbus_bus_add_match(connection_,
+        "type='signal',sender='org.freedesktop.UPower',interface='org.freedesktop.DBus.Properties',"
+        "member='PropertiesChanged',path_namespace='/org/freedesktop/UPower/devices',"
+        "arg0='org.freedesktop.UPower.Device'",
+        nullptr);
+}
+
+// Registers path and queues its GetAll. Returns nullptr if already known.
+UPowerDevice* UPowerDeviceTracker::add(const std::string& path, DBusCallQueue& calls) {
+    auto [it, added] = devices_.try_emplace(path);
+    if (!added) {
+        return nullptr;
+    }
+    it->second = std::make_unique<UPowerDevice>(connection_, path);
+    it->second->requestProperties(calls);
+    return it->second.get();
+}
+
+bool UPowerDeviceTracker::remove(const std::string& path) {
+    return devices_.erase(path) != 0;
+}
+
+UPowerDevice* UPowerDeviceTracker::find(const char* path) {
+    auto it = devices_.find(path);
+    return it == devices_.end() ? nullptr : it->second.get();
+}
+
+// Reconciles the set with EnumerateDevices: vanished devices are dropped,
+// and new and surviving ones are fetched on the same queue, so the whole
+// sync is pipelined. Nothing is fetched before the reply, so no GetAll can
+// outlive its device.
+void UPowerDeviceTracker::enumerate(DBusCallQueue& calls) {
+    DBusMessage* msg;
+
+    msg = dbus_message_new_method_call("org.freedesktop.UPower",
+                                       "/org/freedesktop/UPower",
+                                       "org.freedesktop.UPower",
+                                       "EnumerateDevices");
+
+    if (!msg) {
+        std::cerr << "Failed to create message" << std::endl;
+        std::exit(1);
+    }
+
+    calls.call(msg, [this, &calls](const DBusCallResult& result) {
+        if (!result.ok()) {
+            std::cerr << "Error in D-Bus method call: " << result.error_message << std::endl;
+            return;
+        }
         DBusMessageIter args;
-        if (dbus_message_iter_init(reply, &args)) {
-            DBusMessageIter arrayIter;
-            dbus_message_iter_recurse(&args, &arrayIter);
-            while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRUCT) {
-                DBusMessageIter structIter;
-                dbus_message_iter_recurse(&arrayIter, &structIter);
-                while (dbus_message_iter_get_arg_type(&structIter) != DBUS_TYPE_INVALID) {
-                    if (dbus_message_iter_get_arg_type(&structIter) == DBUS_TYPE_STRING) {
-                        const char* value;
-                        dbus_message_iter_get_basic(&structIter, &value);
-                        dataValue += std::string(value) + " ";
-                    }
-                    dbus_message_iter_next(&structIter);
-                }
-                data_.push_back(dataValue);
-                dataValue.clear();
-                dbus_message_iter_next(&arrayIter);
+        if (!dbus_message_has_signature(result.reply, "ao") || !dbus_message_iter_init(result.reply, &args)) {
+            std::cerr << "Unexpected EnumerateDevices reply signature" << std::endl;
+            return;
+        }
+
+        std::map<std::string, std::unique_ptr<UPowerDevice>> previous;
+        previous.swap(devices_);
+        DBusMessageIter arrayIter;
+        dbus_message_iter_recurse(&args, &arrayIter);
+        while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_OBJECT_PATH) {
+            const char* path;
+            dbus_message_iter_get_basic(&arrayIter, &path);
+            auto it = previous.find(path);
+            if (it != previous.end()) {
+                it->second->requestProperties(calls);
+                devices_.emplace(path, std::move(it->second));
+                previous.erase(it);
+            } else {
+                add(path, calls);
             }
+            dbus_message_iter_next(&arrayIter);
         }
-        dbus_message_unref(reply);
-    }
+        for (const auto& [path, device] : previous) {
+            std::cout << "Device Removed: " << path << std::endl;
+        }
+    });
 
     dbus_message_unref(msg);
-    return dataValue;
 }
 
-void UPowerWakeups::requestData() {
-    getData();
+void UPowerDeviceTracker::requestProperties(DBusCallQueue& calls) {
+    for (auto& [path, device] : devices_) {
+        device->requestProperties(calls);
+    }
 }
 
-void UPowerWakeups::printData() const {
-    for (const auto& entry : data_) {
-        std::cout << "Wakeup Data: " << entry << std::endl;
+void UPowerDeviceTracker::requestHistory(DBusCallQueue& calls, uint32_t timespan) {
+    for (auto& [path, device] : devices_) {
+        device->requestHistory(calls, timespan);
+        device->requestStatistics(calls);
+    }
+}
+
+void UPowerDeviceTracker::printProperties() const {
+    for (const auto& [path, device] : devices_) {
+        std::cout << "Device: " << path << std::endl;
+        device->printProperties();
     }
 }
 
@@ -201,79 +741,268 @@ DBusConnection* connectToBus(DBusError* error) {
     return connection;
 }
 
+// DeviceAdded/DeviceRemoved carry an object path; UPower before 0.99
+// sent it as a string.
+const char* devicePathArg(DBusMessage* message) {
+    DBusMessageIter args;
+    if (!dbus_message_iter_init(message, &args)) {
+        return nullptr;
+    }
+    int type = dbus_message_iter_get_arg_type(&args);
+    if (type != DBUS_TYPE_OBJECT_PATH && type != DBUS_TYPE_STRING) {
+        return nullptr;
+    }
+    const char* path;
+    dbus_message_iter_get_basic(&args, &path);
+    return path;
+}
+
 DBusHandlerResult messageHandler(DBusConnection* connection, 
                                  DBusMessage* message, 
                                  void* user_data) {
-    UPowerDevice* device = static_cast<UPowerDevice*>(user_data);
+    UPowerDeviceTracker* tracker = static_cast<UPowerDeviceTracker*>(user_data);
 
-    const char* interface = dbus_message_get_interface(message);
-    const char* member = dbus_message_get_member(message);
+    if (dbus_message_is_signal(message, "org.freedesktop.DBus.Properties", "PropertiesChanged")) {
+        UPowerDevice* device = tracker->find(dbus_message_get_path(message));
+        if (device && device->handlePropertiesChanged(message)) {
+            return DBUS_HANDLER_RESULT_HANDLED;
+        }
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
 
-    if (strcmp(interface, "org.freedesktop.UPower.Device") == 0) {
-        if (strcmp(member, "PropertiesChanged") == 0) {
-            std::cout << "Device Properties Changed" << std::endl;
-            // Handle properties change here if needed
+    if (dbus_message_is_signal(message, "org.freedesktop.UPower", "DeviceAdded")) {
+        const char* path = devicePathArg(message);
+        if (path) {
+            DBusCallQueue calls(connection);
+            UPowerDevice* device = tracker->add(path, calls);
+            calls.wait();
+            if (device) {
+                std::cout << "Device Added: " << path << std::endl;
+                device->printProperties();
+            }
         }
-    } else if (strcmp(interface, "org.freedesktop.UPower.Wakeups") == 0) {
-        if (strcmp(member, "DataChanged") == 0) {
-            std::cout << "Wakeups Data Changed" << std::endl;
-            // Handle wakeups data change here if needed
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    if (dbus_message_is_signal(message, "org.freedesktop.UPower", "DeviceRemoved")) {
+        const char* path = devicePathArg(message);
+        if (path && tracker->remove(path)) {
+            std::cout << "Device Removed: " << path << std::endl;
+        }
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    // UPower restarted: its device list and every cached value may be stale.
+    if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameOwnerChanged")) {
+        const char* name;
+        const char* oldOwner;
+        const char* newOwner;
+        if (dbus_message_get_args(message, nullptr, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &oldOwner,
+                                  DBUS_TYPE_STRING, &newOwner, DBUS_TYPE_INVALID) &&
+            strcmp(name, "org.freedesktop.UPower") == 0 && newOwner[0] != '\0') {
+            DBusCallQueue calls(connection);
+            tracker->enumerate(calls);
+            calls.wait();
         }
     }
 
-    return DBUS_HANDLER_RESULT_HANDLED;
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-void addMessageFilter(DBusConnection* connection, UPowerDevice& device) {
-    dbus_bus_add_match(connection, 
-        "type='signal',interface='org.freedesktop.UPower.Device'", 
-        nullptr);
-    dbus_connection_add_filter(connection, messageHandler, &device, nullptr);
+DBusHandlerResult wakeupsMessageHandler(DBusConnection* connection,
+                                        DBusMessage* message,
+                                        void* user_data) {
+    UPowerWakeups* wakeups = static_cast<UPowerWakeups*>(user_data);
+
+    if (dbus_message_is_signal(message, "org.freedesktop.UPower.Wakeups", "DataChanged")) {
+        std::cout << "Wakeups Data Changed" << std::endl;
+        wakeups->requestData();
+        wakeups->printChanges();
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void addMessageFilter(DBusConnection* connection, UPowerDeviceTracker& tracker) {
+    tracker.addMatches();
+    dbus_connection_add_filter(connection, messageHandler, &tracker, nullptr);
 }
 
 void addWakeupsMessageFilter(DBusConnection* connection, UPowerWakeups& wakeups) {
     dbus_bus_add_match(connection, 
-        "type='signal',interface='org.freedesktop.UPower.Wakeups'", 
+        "type='signal',sender='org.freedesktop.UPower',interface='org.freedesktop.UPower.Wakeups',member='DataChanged'", 
         nullptr);
-    dbus_connection_add_filter(connection, messageHandler, &wakeups, nullptr);
+    dbus_connection_add_filter(connection, wakeupsMessageHandler, &wakeups, nullptr);
 }
 
-void runMainLoop(DBusConnection* connection, std::vector<UPowerDevice>& devices, UPowerWakeups& wakeups) {
+// Blocks in libdbus until a message arrives or the resync timer is due; all
+// updates come from signals. The periodic GetAll is only a safety net for a
+// missed signal, e.g. across a bus reconnect.
+void runMainLoop(DBusConnection* connection, UPowerDeviceTracker& tracker, UPowerWakeups& wakeups,
+                 std::chrono::milliseconds resyncInterval, uint32_t historySpan) {
+    using Clock = std::chrono::steady_clock;
+    auto nextResync = Clock::now() + resyncInterval;
+
     while (true) {
-        dbus_connection_dispatch(connection);
-        for (auto& device : devices) {
-            device.requestProperties();
-            device.printProperties();
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(nextResync - Clock::now());
+        if (remaining.count() <= 0) {
+            DBusCallQueue calls(connection);
+            tracker.requestProperties(calls);
+            if (historySpan) {
+                tracker.requestHistory(calls, historySpan);
+            }
+            calls.wait();
+            nextResync = Clock::now() + resyncInterval;
+            continue;
+        }
+        if (!dbus_connection_read_write_dispatch(connection, static_cast<int>(remaining.count()))) {
+            std::cerr << "Disconnected from the system bus" << std::endl;
+            return;
         }
-        wakeups.requestData();
-        wakeups.printData();
-        usleep(10000);
     }
 }
 
-int main() {
-    DBusError error;
-    dbus_error_init(&error);
+// Reads /sys/class/power_supply directly: no upowerd or bus needed, and a
+// refresh is a pread instead of a D-Bus round trip. power_supply uevents
+// refresh the supply they name, add/remove rescan, and every interval all
+// supplies are re-read, since most drivers only emit uevents on status
+// changes.
+void runSysfsBackend(std::chrono::seconds interval) {
+    PowerSupplySysfs sysfs;
+    sysfs.scan();
+    for (const auto& [name, supply] : sysfs.supplies()) {
+        sysfs.refresh(name);
+    }
+    for (const auto& [name, supply] : sysfs.supplies()) {
+        std::cout << "Device: " << sysfs.root() << "/" << name << std::endl;
+        printFields("", supply.state, supply.present);
+    }
 
-    DBusConnection* connection = connectToBus(&error);
+    auto refresh = [&sysfs](const std::string& name) {
+        UPowerFieldMask changed = sysfs.refresh(name);
+        auto it = sysfs.supplies().find(name);
+        if (changed && it != sysfs.supplies().end()) {
+            printFields(sysfs.root() + "/" + name + " ", it->second.state, changed);
+        }
+    };
+    auto rescan = [&sysfs, &refresh]() {
+        std::set<std::string> before;
+        for (const auto& [name, supply] : sysfs.supplies()) {
+            before.insert(name);
+        }
+        for (const std::string& name : sysfs.scan()) {
+            std::cout << "Device Added: " << sysfs.root() << "/" << name << std::endl;
+        }
+        for (const std::string& name : before) {
+            if (!sysfs.supplies().count(name)) {
+                std::cout << "Device Removed: " << sysfs.root() << "/" << name << std::endl;
+            }
+        }
+        std::vector<std::string> names;
+        for (const auto& [name, supply] : sysfs.supplies()) {
+            names.push_back(name);
+        }
+        for (const std::string& name : names) {
+            refresh(name);
+        }
+    };
+
+    UeventMonitorOptions options;
+    options.filter.subsystems = {"power_supply"};
+    options.overflow_callback = rescan;
+    int sock = open_uevent_socket(options);
+    if (sock < 0) {
+        std::cerr << "No uevent socket, polling every " << interval.count() << " s" << std::endl;
+        while (true) {
+            std::this_thread::sleep_for(interval);
+            rescan();
+        }
+    }
 
-    std::vector<UPowerDevice> devices = {
-        //UPowerDevice(connection, "/org/freedesktop/UPower/devices/battery_BAT0"),
-        //UPowerDevice(connection, "/org/freedesktop/UPower/devices/line_power_ADP1"),
-        //UPowerDevice(connection, "/org/freedesktop/UPower/devices/DisplayDevice")
+    UeventBatch batch(options.batch_size);
+    auto onEvents = [&](const UeventView* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const UeventView& event = events[i];
+            if (event.get(UeventKey::Subsystem) != "power_supply") {
+                continue;
+            }
+            std::string_view action = event.get(UeventKey::Action);
+            if (action == "add" || action == "remove") {
+                rescan();
+                continue;
+            }
+            std::string_view name = event.get("POWER_SUPPLY_NAME");
+            if (name.empty()) {
+                std::string_view devpath = event.get(UeventKey::Devpath);
+                name = devpath.substr(devpath.rfind('/') + 1);
+            }
+            refresh(std::string(name));
+        }
     };
+    run_edge_triggered_loop(sock, [&]() {
+        return drain_device_events(sock, batch, onEvents, options);
+    }, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(interval).count()), rescan);
+    close(sock);
+}
 
-    UPowerWakeups wakeups(connection);
+int main(int argc, char* argv[]) {
+    // --history SECONDS also pulls charge/rate history and statistics, then
+    // tops the history up at every resync.
+    // --sysfs reads the kernel directly instead of asking UPower; --interval
+    // sets its full re-read period.
+    uint32_t historySpan = 0;
+    bool sysfs = false;
+    long interval = 30;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--sysfs") == 0) {
+            sysfs = true;
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            historySpan = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = std::strtol(argv[++i], nullptr, 10);
+        }
+    }
 
-    for (auto& device : devices) {
-        device.requestProperties();
-        device.printProperties();
-        addMessageFilter(connection, device);
+    if (sysfs) {
+        runSysfsBackend(std::chrono::seconds(interval > 0 ? interval : 30));
+        return 0;
     }
 
+    DBusError error;
+    dbus_error_init(&error);
+
+    DBusConnection* connection = connectToBus(&error);
+
+    UPowerDeviceTracker tracker(connection);
+    UPowerWakeups wakeups(connection);
+
+    // Subscribe before the initial fetch so no change falls in between.
+    addMessageFilter(connection, tracker);
+    dbus_bus_add_match(connection,
+        "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+        "member='NameOwnerChanged',arg0='org.freedesktop.UPower'",
+        nullptr);
     addWakeupsMessageFilter(connection, wakeups);
 
-    runMainLoop(connection, devices, wakeups);
+    // Discovery, every device's GetAll and the wakeups fetch share one
+    // pipelined queue: two round trips however many devices there are.
+    DBusCallQueue calls(connection);
+    tracker.enumerate(calls);
+    wakeups.requestData(calls);
+    calls.wait();
+
+    tracker.printProperties();
+    wakeups.printData();
+
+    // HasHistory/HasStatistics are only known once GetAll has completed.
+    if (historySpan) {
+        DBusCallQueue historyCalls(connection);
+        tracker.requestHistory(historyCalls, historySpan);
+        historyCalls.wait();
+    }
+
+    runMainLoop(connection, tracker, wakeups, std::chrono::minutes(5), historySpan);
 
     dbus_connection_unref(connection);
     return 0;
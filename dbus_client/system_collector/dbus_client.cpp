@@ -4,7 +4,10 @@
 #include <string>
 #include <cstring>
 #include <optional>
+#include <chrono>
 
+#include "../common/dbus_async.h"
+#include "../common/dbus_event_loop.h"
 
 DBusConnection* connectToBus(DBusError* error) {
     DBusConnection* connection = dbus_bus_get(DBUS_BUS_SYSTEM, error);
@@ -21,11 +24,10 @@ DBusConnection* connectToBus(DBusError* error) {
     return connection;
 }
 
-std::string getUPowerProperty(DBusConnection* connection, const char* propertyName) {
+// Queues a Properties.Get for propertyName; propertyValue is filled in when
+// the queue completes the call.
+void getUPowerProperty(DBusCallQueue& calls, const char* propertyName, std::string& propertyValue) {
     DBusMessage* msg;
-    DBusMessage* reply;
-    DBusError error;
-    dbus_error_init(&error);
 
     // Create a method call to org.freedesktop.DBus.Properties.Get
     msg = dbus_message_new_method_call("org.freedesktop.UPower",               // Target for the method call
@@ -42,16 +44,13 @@ std::string getUPowerProperty(DBusConnection* connection, const char* propertyNa
     const char* interfaceName = "org.freedesktop.UPower";
     dbus_message_append_args(msg, DBUS_TYPE_STRING, &interfaceName, DBUS_TYPE_STRING, &propertyName, DBUS_TYPE_INVALID);
 
-    // Send the message and wait for a reply
-    reply = dbus_connection_send_with_reply_and_block(connection, msg, -1, &error);
-
-    std::string propertyValue;
-    if (dbus_error_is_set(&error)) {
-        std::cerr << "Error in D-Bus method call: " << error.message << std::endl;
-        dbus_error_free(&error);
-    } else if (reply) {
+    calls.call(msg, [&propertyValue](const DBusCallResult& result) {
+        if (!result.ok()) {
+            std::cerr << "Error in D-Bus method call: " << result.error_message << std::endl;
+            return;
+        }
         DBusMessageIter args;
-        if (dbus_message_iter_init(reply, &args)) {
+        if (dbus_message_iter_init(result.reply, &args)) {
             if (DBUS_TYPE_VARIANT == dbus_message_iter_get_arg_type(&args)) {
                 DBusMessageIter variantIter;
                 dbus_message_iter_recurse(&args, &variantIter);
@@ -60,41 +59,46 @@ std::string getUPowerProperty(DBusConnection* connection, const char* propertyNa
                     dbus_message_iter_get_basic(&variantIter, &value);
                     propertyValue = value;
                 } else if (DBUS_TYPE_BOOLEAN == dbus_message_iter_get_arg_type(&variantIter)) {
-                    bool value;
+                    dbus_bool_t value;
                     dbus_message_iter_get_basic(&variantIter, &value);
                     propertyValue = value ? "true" : "false";
                 }
                 // Add more types as needed
             }
         }
-        dbus_message_unref(reply);
-    }
+    });
 
     dbus_message_unref(msg);
-    return propertyValue;
 }
 
+// All four Gets are in flight at once, so this costs one round trip.
 void requestUPowerProperties(DBusConnection* connection) {
-    std::cout << "DaemonVersion: " << getUPowerProperty(connection, "DaemonVersion") << std::endl;
-    std::cout << "LidIsClosed: " << getUPowerProperty(connection, "LidIsClosed") << std::endl;
-    std::cout << "LidIsPresent: " << getUPowerProperty(connection, "LidIsPresent") << std::endl;
-    std::cout << "OnBattery: " << getUPowerProperty(connection, "OnBattery") << std::endl;
+    const char* names[] = {"DaemonVersion", "LidIsClosed", "LidIsPresent", "OnBattery"};
+    std::string values[4];
+
+    DBusCallQueue calls(connection);
+    for (int i = 0; i < 4; ++i) {
+        getUPowerProperty(calls, names[i], values[i]);
+    }
+    calls.wait();
+
+    for (int i = 0; i < 4; ++i) {
+        std::cout << names[i] << ": " << values[i] << std::endl;
+    }
 }
 
 DBusHandlerResult messageHandler(DBusConnection* connection __attribute__((unused)), 
                                  DBusMessage* message, 
                                  void* user_data __attribute__((unused))) {
-    const char* interface = dbus_message_get_interface(message);
-    const char* member = dbus_message_get_member(message);
-
-    if (strcmp(interface, "org.freedesktop.UPower") == 0) {
-        if (strcmp(member, "DeviceAdded") == 0) {
-            std::cout << "Device Added" << std::endl;
-        } else if (strcmp(member, "DeviceRemoved") == 0) {
-            std::cout << "Device Removed" << std::endl;
-        } else if (strcmp(member, "PropertiesChanged") == 0) {
-            std::cout << "Properties Changed" << std::endl;
-        }
+    if (dbus_message_is_signal(message, "org.freedesktop.UPower", "DeviceAdded")) {
+        std::cout << "Device Added" << std::endl;
+    } else if (dbus_message_is_signal(message, "org.freedesktop.UPower", "DeviceRemoved")) {
+        std::cout << "Device Removed" << std::endl;
+    } else if (dbus_message_is_signal(message, "org.freedesktop.DBus.Properties", "PropertiesChanged") &&
+               dbus_message_has_path(message, "/org/freedesktop/UPower")) {
+        std::cout << "Properties Changed" << std::endl;
+    } else {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
     return DBUS_HANDLER_RESULT_HANDLED;
@@ -102,33 +106,44 @@ DBusHandlerResult messageHandler(DBusConnection* connection __attribute__((unuse
 
 void addMessageFilter(DBusConnection* connection) {
     dbus_bus_add_match(connection, 
-        "type='signal',interface='org.freedesktop.UPower'", 
+        "type='signal',sender='org.freedesktop.UPower',interface='org.freedesktop.UPower'", 
+        nullptr);
+    dbus_bus_add_match(connection,
+        "type='signal',sender='org.freedesktop.UPower',interface='org.freedesktop.DBus.Properties',"
+        "member='PropertiesChanged',path='/org/freedesktop/UPower'",
         nullptr);
     dbus_connection_add_filter(connection, messageHandler, nullptr, nullptr);
 }
 
-void runMainLoop(DBusConnection* connection) {
-    while (true) {
-        dbus_connection_read_write(connection, 0);
-        DBusMessage* message = dbus_connection_pop_message(connection);
-
-        if (message) {
-            dbus_message_unref(message);
-        }
+// Sleeps in epoll until the bus socket or a libdbus timer needs attention, so
+// signals reach the filter as soon as they arrive and an idle collector costs
+// nothing. After idleSeconds without traffic the properties are re-read.
+void runMainLoop(DBusConnection* connection, int idleSeconds) {
+    DBusEventLoop loop(connection);
+    if (!loop.attach()) {
+        return;
+    }
+    if (idleSeconds > 0) {
+        loop.setIdleTimer(std::chrono::seconds(idleSeconds), [connection]() {
+            requestUPowerProperties(connection);
+        });
     }
+    loop.run();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     DBusError error;
     dbus_error_init(&error);
 
+    int idleSeconds = argc > 1 ? std::atoi(argv[1]) : 0;
+
     DBusConnection* connection = connectToBus(&error);
 
     // Request UPower properties at startup
     requestUPowerProperties(connection);
 
     addMessageFilter(connection);
-    runMainLoop(connection);
+    runMainLoop(connection, idleSeconds);
 
     dbus_connection_unref(connection);
     return 0;
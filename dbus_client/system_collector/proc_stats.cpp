@@ -1,28 +1,287 @@
 #include <dbus/dbus.h>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <cstdlib>
+#include <cstdint>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <chrono>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../common/dbus_async.h"
+
+#define PEER_SCAN_MAX_IN_FLIGHT 64
+#define PROC_READ_BUFFER_SIZE 4096
+
+// What the bus driver knows about one peer. Fields stay unset when the
+// corresponding query failed; error keeps the first failure.
+struct ProcessInfo {
+    bool hasPid = false;
+    uint32_t pid = 0;
+    bool hasUid = false;
+    uint32_t uid = 0;
+    std::vector<uint32_t> gids;
+    std::string error;
+    std::chrono::microseconds latency{0}; // slowest query for this peer
+};
+
+// A bus driver method that takes a peer name and describes it.
+struct PeerQuery {
+    const char* method;
+    void (*parse)(DBusMessage* reply, ProcessInfo& info);
+};
+
+void parseUnixProcessID(DBusMessage* reply, ProcessInfo& info) {
+    dbus_uint32_t pid;
+    if (dbus_message_get_args(reply, nullptr, DBUS_TYPE_UINT32, &pid, DBUS_TYPE_INVALID)) {
+        info.hasPid = true;
+        info.pid = pid;
+    }
+}
+
+// a{sv} with UnixUserID, ProcessID, UnixGroupIDs and optional extras.
+void parseConnectionCredentials(DBusMessage* reply, ProcessInfo& info) {
+    DBusMessageIter args;
+    if (!dbus_message_iter_init(reply, &args) || dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_ARRAY) {
+        return;
+    }
+    DBusMessageIter dictIter;
+    dbus_message_iter_recurse(&args, &dictIter);
+    while (dbus_message_iter_get_arg_type(&dictIter) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entryIter;
+        DBusMessageIter variantIter;
+        dbus_message_iter_recurse(&dictIter, &entryIter);
+        const char* key;
+        dbus_message_iter_get_basic(&entryIter, &key);
+        dbus_message_iter_next(&entryIter);
+        dbus_message_iter_recurse(&entryIter, &variantIter);
+        int type = dbus_message_iter_get_arg_type(&variantIter);
+
+        if (type == DBUS_TYPE_UINT32 && strcmp(key, "UnixUserID") == 0) {
+            dbus_uint32_t uid;
+            dbus_message_iter_get_basic(&variantIter, &uid);
+            info.hasUid = true;
+            info.uid = uid;
+        } else if (type == DBUS_TYPE_UINT32 && strcmp(key, "ProcessID") == 0) {
+            dbus_uint32_t pid;
+            dbus_message_iter_get_basic(&variantIter, &pid);
+            info.hasPid = true;
+            info.pid = pid;
+        } else if (type == DBUS_TYPE_ARRAY && strcmp(key, "UnixGroupIDs") == 0) {
+            DBusMessageIter gidIter;
+            dbus_message_iter_recurse(&variantIter, &gidIter);
+            info.gids.clear();
+            while (dbus_message_iter_get_arg_type(&gidIter) == DBUS_TYPE_UINT32) {
+                dbus_uint32_t gid;
+                dbus_message_iter_get_basic(&gidIter, &gid);
+                info.gids.push_back(gid);
+                dbus_message_iter_next(&gidIter);
+            }
+        }
+        dbus_message_iter_next(&dictIter);
+    }
+}
+
+const std::vector<PeerQuery> kDefaultPeerQueries = {
+    {"GetConnectionUnixProcessID", parseUnixProcessID},
+    {"GetConnectionCredentials", parseConnectionCredentials},
+};
+
+// Per-process counters from /proc/<pid>/stat, statm and status.
+struct ProcStats {
+    char state = '?';
+    uint64_t utime = 0;          // clock ticks
+    uint64_t stime = 0;          // clock ticks
+    uint64_t startTime = 0;      // ticks after boot; tells a reused PID apart
+    uint64_t threads = 0;
+    uint64_t residentPages = 0;
+    uint64_t sharedPages = 0;
+    uint64_t vmHwmKb = 0;        // peak RSS
+    uint64_t voluntarySwitches = 0;
+    uint64_t involuntarySwitches = 0;
+};
+
+// Skips leading spaces, parses an unsigned decimal and advances text past it.
+bool parseUnsigned(std::string_view& text, uint64_t& value) {
+    size_t pos = 0;
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) {
+        ++pos;
+    }
+    size_t start = pos;
+    value = 0;
+    while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+        value = value * 10 + static_cast<uint64_t>(text[pos] - '0');
+        ++pos;
+    }
+    text.remove_prefix(pos);
+    return pos > start;
+}
+
+void skipFields(std::string_view& text, int count) {
+    for (int i = 0; i < count; ++i) {
+        size_t start = text.find_first_not_of(' ');
+        size_t end = start == std::string_view::npos ? std::string_view::npos : text.find(' ', start);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end);
+    }
+}
+
+// Reads /proc files into one buffer that is reused for every process, so a
+// sample costs three open/read/close sequences per PID and no allocation.
+class ProcStatReader {
+public:
+    ProcStatReader() : buffer_(PROC_READ_BUFFER_SIZE) {}
+
+    bool read(uint32_t pid, ProcStats& stats) {
+        char path[64];
+        std::string_view contents;
+
+        snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+        if (!readFile(path, contents) || !parseStat(contents, stats)) {
+            return false;
+        }
+        snprintf(path, sizeof(path), "/proc/%u/statm", pid);
+        if (readFile(path, contents)) {
+            parseStatm(contents, stats);
+        }
+        snprintf(path, sizeof(path), "/proc/%u/status", pid);
+        if (readFile(path, contents)) {
+            parseStatus(contents, stats);
+        }
+        return true;
+    }
+
+private:
+    bool readFile(const char* path, std::string_view& contents) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        size_t used = 0;
+        while (true) {
+            if (used == buffer_.size()) {
+                buffer_.resize(buffer_.size() * 2);
+            }
+            ssize_t n = ::read(fd, buffer_.data() + used, buffer_.size() - used);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            used += static_cast<size_t>(n);
+        }
+        close(fd);
+        contents = std::string_view(buffer_.data(), used);
+        return used > 0;
+    }
+
+    // "pid (comm) state ppid ...": comm may hold spaces and parentheses, so
+    // fields are counted from the last ')'. See proc(5) for the numbering.
+    static bool parseStat(std::string_view text, ProcStats& stats) {
+        size_t close = text.rfind(')');
+        if (close == std::string_view::npos || close + 2 >= text.size()) {
+            return false;
+        }
+        text.remove_prefix(close + 2);
+        stats.state = text[0];
+        text.remove_prefix(1);
+        skipFields(text, 10);                      // fields 4-13
+        if (!parseUnsigned(text, stats.utime) ||   // 14
+            !parseUnsigned(text, stats.stime)) {   // 15
+            return false;
+        }
+        skipFields(text, 4);                       // 16-19
+        parseUnsigned(text, stats.threads);        // 20
+        skipFields(text, 1);                       // 21
+        parseUnsigned(text, stats.startTime);      // 22
+        return true;
+    }
+
+    // "size resident shared text lib data dt", in pages.
+    static void parseStatm(std::string_view text, ProcStats& stats) {
+        uint64_t size;
+        if (parseUnsigned(text, size) && parseUnsigned(text, stats.residentPages)) {
+            parseUnsigned(text, stats.sharedPages);
+        }
+    }
+
+    static void parseStatus(std::string_view text, ProcStats& stats) {
+        while (!text.empty()) {
+            size_t end = text.find('\n');
+            std::string_view line = text.substr(0, end);
+            text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+            std::string_view key = line.substr(0, colon);
+            std::string_view value = line.substr(colon + 1);
+            if (key == "VmHWM") {
+                parseUnsigned(value, stats.vmHwmKb);
+            } else if (key == "voluntary_ctxt_switches") {
+                parseUnsigned(value, stats.voluntarySwitches);
+            } else if (key == "nonvoluntary_ctxt_switches") {
+                parseUnsigned(value, stats.involuntarySwitches);
+            }
+        }
+    }
+
+    std::vector<char> buffer_;
+};
+
+// One row of the service table: a process and every bus name it owns.
+struct ServiceSample {
+    uint32_t pid = 0;
+    uint32_t uid = 0;
+    bool hasUid = false;             // credentials lookup may fail even when the PID is known
+    std::vector<std::string> names;
+    ProcStats stats;
+    double cpuPercent = -1;          // unknown until the second sample
+    int64_t switchesDelta = -1;
+};
 
 class SystemProcess {
 public:
     SystemProcess(DBusConnection* connection);
 
     void listProcesses();
-    void getProcessData(const std::string& processId);
+    void getProcessData(DBusCallQueue& calls, const std::string& processId,
+                        const std::vector<PeerQuery>& queries = kDefaultPeerQueries);
+    // Runs every query for every listed name with at most maxInFlight calls
+    // outstanding. Peers that time out or fail keep whatever did succeed.
+    void scanProcesses(const std::vector<PeerQuery>& queries = kDefaultPeerQueries,
+                       size_t maxInFlight = PEER_SCAN_MAX_IN_FLIGHT, int timeoutMs = DBUS_CALL_TIMEOUT_MS);
     void printProcessData() const;
+    // Reads /proc for every resolved PID and computes CPU use and context
+    // switches since the previous sample of the same process.
+    void sampleServices();
+    void printServiceTable() const;
     
     // New public method to access process data
-    const std::map<std::string, std::string>& getProcesses() const;
+    const std::map<std::string, ProcessInfo>& getProcesses() const;
+
+    std::chrono::microseconds lastScanTime() const { return scanTime_; }
 
 private:
     DBusConnection* connection_;
-    std::map<std::string, std::string> processes_;
+    std::map<std::string, ProcessInfo> processes_;
+    std::chrono::microseconds scanTime_{0};
+    ProcStatReader reader_;
+    std::vector<ServiceSample> services_;
+    std::map<uint32_t, ProcStats> previous_;
+    std::chrono::steady_clock::time_point previousTime_;
 };
 
 // Implementation of new accessor method
-const std::map<std::string, std::string>& SystemProcess::getProcesses() const {
+const std::map<std::string, ProcessInfo>& SystemProcess::getProcesses() const {
     return processes_;
 }
 
@@ -45,8 +304,9 @@ void SystemProcess::listProcesses() {
         std::exit(1);
     }
 
-    reply = dbus_connection_send_with_reply_and_block(connection_, msg, -1, &error);
+    reply = dbus_connection_send_with_reply_and_block(connection_, msg, DBUS_CALL_TIMEOUT_MS, &error);
 
+    processes_.clear();
     if (dbus_error_is_set(&error)) {
         std::cerr << "Error in D-Bus method call: " << error.message << std::endl;
         dbus_error_free(&error);
@@ -58,7 +318,7 @@ void SystemProcess::listProcesses() {
             while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRING) {
                 const char* name;
                 dbus_message_iter_get_basic(&arrayIter, &name);
-                processes_[name] = "No data"; // Placeholder for actual process data
+                processes_[name] = ProcessInfo();
                 dbus_message_iter_next(&arrayIter);
             }
         }
@@ -68,77 +328,214 @@ void SystemProcess::listProcesses() {
     dbus_message_unref(msg);
 }
 
-void SystemProcess::getProcessData(const std::string& processId) {
-    DBusMessage* msg;
-    DBusMessage* reply;
-    DBusError error;
-    dbus_error_init(&error);
+// Queues every query for one peer. Each is a bus driver call taking the
+// peer name, so well-known names resolve to their current owner.
+void SystemProcess::getProcessData(DBusCallQueue& calls, const std::string& processId,
+                                   const std::vector<PeerQuery>& queries) {
+    for (const auto& query : queries) {
+        DBusMessage* msg;
 
-    msg = dbus_message_new_method_call("org.freedesktop.DBus",
-                                       processId.c_str(), // Placeholder, adjust as needed
-                                       "org.freedesktop.DBus",
-                                       "GetData"); // Placeholder method name
+        msg = dbus_message_new_method_call("org.freedesktop.DBus",
+                                           "/org/freedesktop/DBus",
+                                           "org.freedesktop.DBus",
+                                           query.method);
 
-    if (!msg) {
-        std::cerr << "Failed to create message" << std::endl;
-        std::exit(1);
+        if (!msg) {
+            std::cerr << "Failed to create message" << std::endl;
+            std::exit(1);
+        }
+
+        const char* name = processId.c_str();
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+
+        calls.call(msg, [this, processId, parse = query.parse](const DBusCallResult& result) {
+            ProcessInfo& info = processes_[processId];
+            info.latency = std::max(info.latency, result.latency);
+            if (!result.ok()) {
+                if (info.error.empty()) {
+                    info.error = result.error_name;
+                }
+                return;
+            }
+            parse(result.reply, info);
+        });
+
+        dbus_message_unref(msg);
     }
+}
 
-    reply = dbus_connection_send_with_reply_and_block(connection_, msg, -1, &error);
+void SystemProcess::scanProcesses(const std::vector<PeerQuery>& queries, size_t maxInFlight, int timeoutMs) {
+    auto start = std::chrono::steady_clock::now();
 
-    if (dbus_error_is_set(&error)) {
-        std::cerr << "Error in D-Bus method call: " << error.message << std::endl;
-        dbus_error_free(&error);
-    } else if (reply) {
-        DBusMessageIter args;
-        if (dbus_message_iter_init(reply, &args) && DBUS_TYPE_STRING == dbus_message_iter_get_arg_type(&args)) {
-            const char* data;
-            dbus_message_iter_get_basic(&args, &data);
-            processes_[processId] = data;
-        }
-        dbus_message_unref(reply);
+    // Collect the names first, since replies update the map being iterated.
+    std::vector<std::string> names;
+    for (auto& [processId, info] : processes_) {
+        names.push_back(processId);
+        info = ProcessInfo();
     }
 
-    dbus_message_unref(msg);
+    DBusCallQueue calls(connection_, maxInFlight, timeoutMs);
+    for (const auto& processId : names) {
+        getProcessData(calls, processId, queries);
+    }
+    calls.wait();
+
+    scanTime_ = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
 }
 
 void SystemProcess::printProcessData() const {
-    for (const auto& [processId, data] : processes_) {
-        std::cout << "Process ID: " << processId << " Data: " << data << std::endl;
+    std::cout << std::left << std::setw(40) << "NAME" << std::right << std::setw(8) << "PID"
+              << std::setw(8) << "UID" << std::setw(12) << "LATENCY_US" << "  ERROR" << std::endl;
+    for (const auto& [processId, info] : processes_) {
+        std::cout << std::left << std::setw(40) << processId << std::right
+                  << std::setw(8) << (info.hasPid ? std::to_string(info.pid) : "-")
+                  << std::setw(8) << (info.hasUid ? std::to_string(info.uid) : "-")
+                  << std::setw(12) << info.latency.count()
+                  << "  " << info.error << std::endl;
     }
+    std::cout << processes_.size() << " names scanned in " << scanTime_.count() << " us" << std::endl;
 }
 
-DBusConnection* connectToBus(DBusError* error) {
-    DBusConnection* connection = dbus_bus_get(DBUS_BUS_SESSION, error);
+void SystemProcess::sampleServices() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - previousTime_).count();
+    static const double ticksPerSecond = static_cast<double>(sysconf(_SC_CLK_TCK));
+
+    // Several names usually share one process; read /proc once per PID.
+    std::map<uint32_t, size_t> rows;
+    services_.clear();
+    for (const auto& [name, info] : processes_) {
+        if (!info.hasPid) {
+            continue;
+        }
+        auto [it, inserted] = rows.emplace(info.pid, services_.size());
+        if (inserted) {
+            ServiceSample sample;
+            sample.pid = info.pid;
+            services_.push_back(sample);
+        }
+        ServiceSample& sample = services_[it->second];
+        if (info.hasUid && !sample.hasUid) {
+            sample.uid = info.uid;
+            sample.hasUid = true;
+        }
+        sample.names.push_back(name);
+    }
+
+    std::map<uint32_t, ProcStats> current;
+    for (auto& sample : services_) {
+        if (!reader_.read(sample.pid, sample.stats)) {
+            continue;
+        }
+        current[sample.pid] = sample.stats;
+
+        auto prev = previous_.find(sample.pid);
+        if (prev == previous_.end() || prev->second.startTime != sample.stats.startTime || elapsed <= 0) {
+            continue;
+        }
+        uint64_t ticks = (sample.stats.utime + sample.stats.stime) - (prev->second.utime + prev->second.stime);
+        sample.cpuPercent = 100.0 * static_cast<double>(ticks) / ticksPerSecond / elapsed;
+        sample.switchesDelta = static_cast<int64_t>(sample.stats.voluntarySwitches + sample.stats.involuntarySwitches) -
+                               static_cast<int64_t>(prev->second.voluntarySwitches + prev->second.involuntarySwitches);
+    }
+
+    previous_ = std::move(current);
+    previousTime_ = now;
+    std::sort(services_.begin(), services_.end(), [](const ServiceSample& a, const ServiceSample& b) {
+        return a.cpuPercent != b.cpuPercent ? a.cpuPercent > b.cpuPercent
+                                            : a.stats.residentPages > b.stats.residentPages;
+    });
+}
+
+void SystemProcess::printServiceTable() const {
+    static const uint64_t pageKb = static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+
+    std::cout << std::right << std::setw(8) << "PID" << std::setw(7) << "UID" << std::setw(8) << "CPU%"
+              << std::setw(10) << "RSS_KB" << std::setw(10) << "HWM_KB" << std::setw(8) << "THREADS"
+              << std::setw(8) << "CSW" << "  NAMES" << std::endl;
+    for (const auto& sample : services_) {
+        // Prefer well-known names; a unique name alone is shown as is.
+        std::string names;
+        for (const auto& name : sample.names) {
+            if (name[0] != ':' || sample.names.size() == 1) {
+                names += (names.empty() ? "" : ",") + name;
+            }
+        }
+        std::ostringstream cpu;
+        if (sample.cpuPercent >= 0) {
+            cpu << std::fixed << std::setprecision(1) << sample.cpuPercent;
+        } else {
+            cpu << "-";
+        }
+        std::cout << std::setw(8) << sample.pid << std::setw(7) << (sample.hasUid ? std::to_string(sample.uid) : "-") << std::setw(8) << cpu.str()
+                  << std::setw(10) << sample.stats.residentPages * pageKb << std::setw(10) << sample.stats.vmHwmKb
+                  << std::setw(8) << sample.stats.threads
+                  << std::setw(8) << (sample.switchesDelta >= 0 ? std::to_string(sample.switchesDelta) : "-")
+                  << "  " << (names.empty() ? sample.names.front() : names) << std::endl;
+    }
+}
+
+DBusConnection* connectToBus(DBusBusType type, DBusError* error) {
+    const char* busName = type == DBUS_BUS_SYSTEM ? "system" : "session";
+    DBusConnection* connection = dbus_bus_get(type, error);
     if (dbus_error_is_set(error)) {
-        std::cerr << "Error connecting to the session bus: " << error->message << std::endl;
+        std::cerr << "Error connecting to the " << busName << " bus: " << error->message << std::endl;
         dbus_error_free(error);
     }
 
     if (!connection) {
-        std::cerr << "Failed to connect to the session bus" << std::endl;
+        std::cerr << "Failed to connect to the " << busName << " bus" << std::endl;
         std::exit(1);
     }
 
     return connection;
 }
 
-int main() {
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--system] [--peers] [--interval SECONDS] [--count N]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
     DBusError error;
     dbus_error_init(&error);
 
-    DBusConnection* connection = connectToBus(&error);
+    DBusBusType busType = DBUS_BUS_SESSION;
+    bool showPeers = false;
+    int intervalSeconds = 1;
+    int count = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--system") == 0) {
+            busType = DBUS_BUS_SYSTEM;
+        } else if (strcmp(argv[i], "--peers") == 0) {
+            showPeers = true;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            intervalSeconds = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = std::atoi(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
 
-    SystemProcess sysProc(connection);
-    sysProc.listProcesses();
+    DBusConnection* connection = connectToBus(busType, &error);
 
-    // Simulate fetching data for each process
-    for (const auto& [processId, _] : sysProc.getProcesses()) {
-        sysProc.getProcessData(processId);
+    SystemProcess sysProc(connection);
+    for (int sample = 0; sample < count; ++sample) {
+        if (sample > 0) {
+            sleep(intervalSeconds);
+            std::cout << std::endl;
+        }
+        // Names come and go, so resolve them again for every sample.
+        sysProc.listProcesses();
+        sysProc.scanProcesses();
+        if (showPeers) {
+            sysProc.printProcessData();
+        }
+        sysProc.sampleServices();
+        sysProc.printServiceTable();
     }
 
-    sysProc.printProcessData();
-
     dbus_connection_unref(connection);
     return 0;
 }
@@ -2,23 +2,39 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <tinyxml2.h>
+#include <map>
+#include <set>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <string_view>
+
+#include "../common/dbus_async.h"
+#include "../common/introspection_xml.h"
+#include "../common/string_interner.h"
 
 // Class to represent a node in the introspected data
 class DBusNode {
 public:
     std::string name;
-    std::vector<std::string> interfaces;
+    std::vector<InternedString> interfaces;
     std::vector<DBusNode> children;
 
     DBusNode(const std::string& nodeName) : name(nodeName) {}
 
-    void addInterface(const std::string& iface) {
+    // Subtrees are only ever moved; copying one is almost always a mistake.
+    DBusNode(const DBusNode&) = delete;
+    DBusNode& operator=(const DBusNode&) = delete;
+    DBusNode(DBusNode&&) = default;
+    DBusNode& operator=(DBusNode&&) = default;
+
+    void addInterface(InternedString iface) {
         interfaces.push_back(iface);
     }
 
-    void addChild(const DBusNode& childNode) {
-        children.push_back(childNode);
+    void addChild(DBusNode childNode) {
+        children.push_back(std::move(childNode));
     }
 
     void print(int indent = 0) const {
@@ -33,74 +49,176 @@ public:
     }
 };
 
-DBusNode parseIntrospectionXML(const std::string& xmlData, const std::string& rootPath) {
-    using namespace tinyxml2;
+std::string childPath(const std::string& parentPath, std::string_view childName) {
+    if (childName[0] == '/') {
+        return std::string(childName);
+    }
+    std::string path = parentPath;
+    if (path != "/") {
+        path += '/';
+    }
+    path += childName;
+    return path;
+}
 
+// doc is scratch space; passing the same one for every reply lets the parser
+// reuse its buffers.
+DBusNode parseIntrospectionXML(std::string_view xmlData, const std::string& rootPath, IntrospectionDocument& doc) {
     DBusNode rootNode(rootPath);
-    XMLDocument doc;
-    if (doc.Parse(xmlData.c_str()) != XML_SUCCESS) {
+    if (!parse_introspection_xml(xmlData, doc)) {
         std::cerr << "Failed to parse XML data." << std::endl;
-        return rootNode;
-    }
-
-    XMLElement* rootElement = doc.FirstChildElement("node");
-    if (!rootElement) {
-        std::cerr << "Invalid introspection data." << std::endl;
-        return rootNode;
     }
 
     // Parse interfaces of the current node
-    for (XMLElement* interfaceElement = rootElement->FirstChildElement("interface"); interfaceElement != nullptr; interfaceElement = interfaceElement->NextSiblingElement("interface")) {
-        const char* ifaceName = interfaceElement->Attribute("name");
-        if (ifaceName) {
-            rootNode.addInterface(ifaceName);
-        }
+    rootNode.interfaces.reserve(doc.interfaces.size());
+    for (const auto& iface : doc.interfaces) {
+        rootNode.addInterface(iface.name);
     }
 
     // Parse child nodes
-    for (XMLElement* nodeElement = rootElement->FirstChildElement("node"); nodeElement != nullptr; nodeElement = nodeElement->NextSiblingElement("node")) {
-        const char* nodeName = nodeElement->Attribute("name");
-        if (nodeName) {
-            std::string childPath = rootPath + "/" + nodeName;
-            rootNode.addChild(DBusNode(childPath));
-        }
+    rootNode.children.reserve(doc.children.size());
+    for (std::string_view nodeName : doc.children) {
+        rootNode.addChild(DBusNode(childPath(rootPath, nodeName)));
     }
 
     return rootNode;
 }
 
-void introspect(DBusConnection* conn, const std::string& path, DBusNode& node) {
-    DBusMessage* msg;
-    msg = dbus_message_new_method_call("org.freedesktop.systemd1", // Target for the method call
-                                       path.c_str(),               // Object path
-                                       "org.freedesktop.DBus.Introspectable", // Interface to call
-                                       "Introspect");              // Method name
-    if (msg == nullptr) {
-        std::cerr << "Failed to create D-Bus message.\n";
-        return;
+struct CrawlOptions {
+    int maxDepth = -1;          // levels below the root; -1 for no limit
+    std::string prefix;         // only visit paths on the way to or under this prefix
+    size_t maxInFlight = 32;
+    int timeoutMs = DBUS_CALL_TIMEOUT_MS;
+};
+
+// Walks an object tree breadth-first. Every node discovered in a reply is
+// introspected right away through the call queue, so up to maxInFlight
+// Introspect calls are outstanding and a tree of N objects costs about one
+// round trip per level instead of N.
+class IntrospectionCrawler {
+public:
+    IntrospectionCrawler(DBusConnection* conn, const std::string& service, const CrawlOptions& options)
+        : conn_(conn), service_(service), options_(options) {}
+
+    DBusNode crawl(const std::string& rootPath) {
+        nodes_.clear();
+        visited_.clear();
+        failures_ = 0;
+
+        DBusCallQueue calls(conn_, options_.maxInFlight, options_.timeoutMs);
+        visit(calls, rootPath, 0);
+        calls.wait();
+
+        return assemble(rootPath);
     }
 
-    DBusMessage* reply;
-    reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, nullptr);
-    dbus_message_unref(msg); // Unreference the message
+    size_t visitedCount() const { return visited_.size(); }
+    size_t failures() const { return failures_; }
 
-    if (reply == nullptr) {
-        std::cerr << "Failed to get a reply from D-Bus.\n";
-        return;
+private:
+    bool allowed(const std::string& path) const {
+        const std::string& prefix = options_.prefix;
+        if (prefix.empty() || path == "/") {
+            return true;
+        }
+        // Ancestors of the prefix must be walked to reach it.
+        if (prefix.compare(0, path.size(), path) == 0 && (prefix.size() == path.size() || prefix[path.size()] == '/')) {
+            return true;
+        }
+        return path.compare(0, prefix.size(), prefix) == 0 && (path.size() == prefix.size() || path[prefix.size()] == '/');
+    }
+
+    void visit(DBusCallQueue& calls, const std::string& path, int depth) {
+        if (!visited_.insert(path).second) {
+            return;
+        }
+
+        DBusMessage* msg = dbus_message_new_method_call(service_.c_str(), path.c_str(),
+                                                        "org.freedesktop.DBus.Introspectable", "Introspect");
+        if (msg == nullptr) {
+            std::cerr << "Failed to create D-Bus message.\n";
+            return;
+        }
+
+        calls.call(msg, [this, &calls, path, depth](const DBusCallResult& result) {
+            const char* xml_data;
+            if (!result.ok()) {
+                std::cerr << "Introspect " << path << " failed: " << result.error_message << "\n";
+                ++failures_;
+                return;
+            }
+            if (!dbus_message_get_args(result.reply, nullptr, DBUS_TYPE_STRING, &xml_data, DBUS_TYPE_INVALID)) {
+                std::cerr << "Failed to read arguments from the reply.\n";
+                ++failures_;
+                return;
+            }
+
+            DBusNode node = parseIntrospectionXML(xml_data, path, doc_);
+            if (options_.maxDepth < 0 || depth < options_.maxDepth) {
+                for (const auto& child : node.children) {
+                    if (allowed(child.name)) {
+                        visit(calls, child.name, depth + 1);
+                    }
+                }
+            }
+            nodes_.emplace(path, std::move(node));
+        });
+
+        dbus_message_unref(msg);
     }
 
-    const char* xml_data;
-    if (!dbus_message_get_args(reply, nullptr, DBUS_TYPE_STRING, &xml_data, DBUS_TYPE_INVALID)) {
-        std::cerr << "Failed to read arguments from the reply.\n";
-    } else {
-        DBusNode parsedNode = parseIntrospectionXML(xml_data, path);
-        node = parsedNode;
+    // Rebuilds the tree from the flat results. Children that were not
+    // crawled (depth limit or failure) stay as bare placeholders.
+    DBusNode assemble(const std::string& path) {
+        auto it = nodes_.find(path);
+        if (it == nodes_.end()) {
+            return DBusNode(path);
+        }
+        DBusNode node = std::move(it->second);
+        nodes_.erase(it);
+
+        std::vector<DBusNode> placeholders = std::move(node.children);
+        node.children.clear();
+        for (const auto& child : placeholders) {
+            if (allowed(child.name)) {
+                node.addChild(assemble(child.name));
+            }
+        }
+        return node;
     }
 
-    dbus_message_unref(reply); // Unreference the reply message
+    DBusConnection* conn_;
+    std::string service_;
+    CrawlOptions options_;
+    std::map<std::string, DBusNode> nodes_;
+    std::set<std::string> visited_;
+    IntrospectionDocument doc_;
+    size_t failures_ = 0;
+};
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--service NAME] [--depth N] [--prefix PATH] [ROOT_PATH]\n";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    std::string service = "org.freedesktop.systemd1";
+    std::string rootPath = "/org/freedesktop/systemd1/unit";
+    CrawlOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--service") == 0 && i + 1 < argc) {
+            service = argv[++i];
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            options.maxDepth = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prefix") == 0 && i + 1 < argc) {
+            options.prefix = argv[++i];
+        } else if (argv[i][0] == '/') {
+            rootPath = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
     DBusError error;
     dbus_error_init(&error);
 
@@ -116,12 +234,16 @@ int main() {
         return 1;
     }
 
-    // Introspect the unit directory of systemd and parse the result
-    DBusNode rootNode("/org/freedesktop/systemd1/unit");
-    introspect(conn, "/org/freedesktop/systemd1/unit", rootNode);
+    // Introspect the unit directory of systemd and everything below it
+    auto start = std::chrono::steady_clock::now();
+    IntrospectionCrawler crawler(conn, service, options);
+    DBusNode rootNode = crawler.crawl(rootPath);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
 
     // Print the introspected data
     rootNode.print();
+    std::cerr << crawler.visitedCount() << " objects introspected in " << elapsed.count() << " ms, "
+              << crawler.failures() << " failed, " << global_interner().size() << " distinct names\n";
 
     // Close the D-Bus connection
     dbus_connection_unref(conn);